@@ -1,4 +1,4 @@
-gfx.init("ReaBlink Monitor", 770, 32)
+gfx.init("ReaBlink Monitor", 770, 48)
 
 header =
     "enabled | num peers | quantum | start stop sync | tempo   | beats(QN) | offset(ms) | metro\n"
@@ -28,23 +28,20 @@ local function main()
     time = time2 or 0
     time2 = reaper.Blink_GetClockNow()
     time_diff = math.abs(time2 - time)
-    linkEnabled = reaper.Blink_GetEnabled()
-    numPeers = reaper.Blink_GetNumPeers()
-    quantum = reaper.Blink_GetQuantum()
-    startStopSyncOn = reaper.Blink_GetStartStopSyncEnabled()
+    linkEnabled, numPeers, startStopSyncOn, playing, tempo, quantum, beats,
+        phase, offset = reaper.Blink_GetSessionSnapshot(time)
     if linkEnabled then
         enable = "yes"
     else
         enable = "no"
     end
-    beats = reaper.Blink_GetBeatAtTime(time, quantum)
-    phase = reaper.Blink_GetPhaseAtTime(time, quantum) * bpmRate
+    phase = phase * bpmRate
     if startStopSyncOn then
         startStop = "yes"
     else
         startStop = "no"
     end
-    if reaper.Blink_GetPlaying() then
+    if playing then
         isPlaying = "[playing]"
     else
         isPlaying = "[stopped]"
@@ -63,12 +60,18 @@ local function main()
         str = str .. string.format("%7d | ", quantum * bpmRate or 1)
         str = str .. string.format("%3s ", startStop)
         str = str .. string.format("%11s | ", isPlaying)
-        str = str .. string.format("%7.2f | ", reaper.Blink_GetTempo())
+        str = str .. string.format("%7.2f | ", tempo)
         str = str .. string.format("%9.2f | ", beats)
-        str = str .. string.format("%10.1f | ", reaper.Blink_GetTimelineOffset()*1000)
+        str = str .. string.format("%10.1f | ", offset*1000)
         str = str .. phaseStr .. "\n"
     end
 
+    _, _, _, intervalP50, intervalP99 = reaper.Blink_GetStats("interval")
+    _, _, _, _, tickP99, tickMax = reaper.Blink_GetStats("tick")
+    str = str .. string.format(
+        "tick interval p50/p99 %.1f/%.1f ms | tick p99/max %.0f/%.0f us\n",
+        intervalP50 / 1000, intervalP99 / 1000, tickP99, tickMax)
+
     gfx.x, gfx.y = 0, 0
     gfx.drawstr(header .. str)
     gfx.update()
@@ -0,0 +1,158 @@
+#ifndef REABLINK_APIREGISTRY_HPP
+#define REABLINK_APIREGISTRY_HPP
+
+#include <array>
+#include <cstddef>
+
+#include <reaper_plugin_functions.h>
+
+#include "reascript_vararg.hpp"
+
+namespace reablink
+{
+// reaper.array as passed to "reaper_array*" parameters
+struct reaper_array
+{
+  unsigned int size;
+  const unsigned int alloc;
+  double data[1];
+};
+
+// ReaScript name and documentation of an exported function. Return and
+// parameter types are taken from the C++ signature.
+struct ApiDoc
+{
+  const char* name;  // e.g. "Blink_GetTempo"
+  const char* args;  // comma separated parameter names
+  const char* help;
+};
+
+template <typename T> struct ReaScriptType;
+
+#define REABLINK_REASCRIPT_TYPE(T)                                             \
+  template <> struct ReaScriptType<T>                                          \
+  {                                                                            \
+    static constexpr const char* name = #T;                                    \
+  }
+
+REABLINK_REASCRIPT_TYPE(void);
+REABLINK_REASCRIPT_TYPE(bool);
+REABLINK_REASCRIPT_TYPE(int);
+REABLINK_REASCRIPT_TYPE(double);
+REABLINK_REASCRIPT_TYPE(const char*);
+REABLINK_REASCRIPT_TYPE(char*);
+REABLINK_REASCRIPT_TYPE(bool*);
+REABLINK_REASCRIPT_TYPE(int*);
+REABLINK_REASCRIPT_TYPE(double*);
+REABLINK_REASCRIPT_TYPE(reaper_array*);
+
+#undef REABLINK_REASCRIPT_TYPE
+
+namespace detail
+{
+constexpr std::size_t length(const char* s)
+{
+  std::size_t n = 0;
+  while (s[n])
+  {
+    ++n;
+  }
+  return n;
+}
+
+template <std::size_t N> struct StringWriter
+{
+  std::array<char, N> out{};
+  std::size_t pos{0};
+
+  constexpr void put(const char* s)
+  {
+    while (*s)
+    {
+      out[pos++] = *s++;
+    }
+  }
+
+  constexpr void end()
+  {
+    out[pos++] = '\0';
+  }
+};
+
+// "-<prefix><name>", registration skips the leading '-'
+template <const ApiDoc& doc, std::size_t PrefixLength>
+constexpr auto registrationKey(const char (&prefix)[PrefixLength])
+{
+  StringWriter<PrefixLength + length(doc.name) + 1> writer;
+  writer.put("-");
+  writer.put(prefix);
+  writer.put(doc.name);
+  writer.end();
+  return writer.out;
+}
+
+template <typename Fn, const ApiDoc& doc> struct ApiStrings;
+
+template <typename R, typename... Args, const ApiDoc& doc>
+struct ApiStrings<R (*)(Args...), doc>
+{
+  static constexpr std::size_t typesLength()
+  {
+    std::size_t n = sizeof...(Args) > 0 ? sizeof...(Args) - 1 : 0;
+    ((n += length(ReaScriptType<Args>::name)), ...);
+    return n;
+  }
+
+  // "ret\0type,type\0name,name\0help"
+  static constexpr auto definition()
+  {
+    StringWriter<length(ReaScriptType<R>::name) + typesLength() +
+                 length(doc.args) + length(doc.help) + 4>
+      writer;
+    writer.put(ReaScriptType<R>::name);
+    writer.end();
+    std::size_t i = 0;
+    ((writer.put(i++ ? "," : ""), writer.put(ReaScriptType<Args>::name)),
+     ...);
+    writer.end();
+    writer.put(doc.args);
+    writer.end();
+    writer.put(doc.help);
+    writer.end();
+    return writer.out;
+  }
+
+  static constexpr auto def = definition();
+  static constexpr auto api = registrationKey<doc>("API_");
+  static constexpr auto apiDef = registrationKey<doc>("APIdef_");
+  static constexpr auto apiVararg = registrationKey<doc>("APIvararg_");
+};
+} // namespace detail
+
+// One ReaScript function, registered as API_, APIdef_ and APIvararg_.
+// All strings are built at compile time.
+struct ApiFunction
+{
+  void (*apply)(bool add);
+
+  template <auto fn, const ApiDoc& doc> static constexpr ApiFunction of()
+  {
+    return ApiFunction{&registration<fn, doc>};
+  }
+
+private:
+  template <auto fn, const ApiDoc& doc> static void registration(bool add)
+  {
+    using Strings = detail::ApiStrings<decltype(fn), doc>;
+    // unregistered with a leading '-'
+    const auto skip = add ? 1 : 0;
+    plugin_register(Strings::api.data() + skip, (void*)fn);
+    plugin_register(Strings::apiDef.data() + skip,
+                    (void*)Strings::def.data());
+    plugin_register(Strings::apiVararg.data() + skip,
+                    reinterpret_cast<void*>(&InvokeReaScriptAPI<fn>));
+  }
+};
+} // namespace reablink
+
+#endif // REABLINK_APIREGISTRY_HPP
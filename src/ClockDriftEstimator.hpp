@@ -0,0 +1,89 @@
+#ifndef REABLINK_CLOCKDRIFTESTIMATOR_HPP
+#define REABLINK_CLOCKDRIFTESTIMATOR_HPP
+
+#include "HostTimeFilter.hpp"
+#include <cstddef>
+
+namespace reablink
+{
+// Rate of the audio clock against the host clock, in parts per million.
+// One point a second of filtered host time goes into a regression over
+// the latest N seconds, long enough to resolve ppm under callback jitter
+// while following the slow wander of a crystal. Single thread, does not
+// allocate.
+template <std::size_t N = 128> class ClockDriftEstimator
+{
+public:
+  static constexpr std::size_t minPoints = 30; // seconds before ready()
+
+  // nominal host time units per sample, host time units per second
+  void reset(double nominalPeriod, double hostRate = 1.0e6)
+  {
+    mNominalPeriod = nominalPeriod;
+    mInterval = hostRate / nominalPeriod;
+    mNextPoint = 0.;
+    mOffset = 0.;
+    mReanchor = false;
+    mFilter.reset(nominalPeriod);
+  }
+
+  double nominalPeriod() const
+  {
+    return mNominalPeriod;
+  }
+
+  // Host time jumped against sample time, as after a dropout. The points
+  // are kept; the next one, a point interval later when the host time
+  // filter has settled again, sets the offset that puts it on their line.
+  void reanchor(double sampleTime)
+  {
+    if (mFilter.size() == 0)
+    {
+      return;
+    }
+    mReanchor = true;
+    mNextPoint = sampleTime + mInterval;
+  }
+
+  // sample time and filtered host time of an audio block
+  void update(double sampleTime, double hostTime)
+  {
+    if (mFilter.size() > 0 && sampleTime < mNextPoint)
+    {
+      return;
+    }
+    if (mReanchor)
+    {
+      mOffset = mFilter.hostTimeAt(sampleTime) - hostTime;
+      mReanchor = false;
+    }
+    mFilter.update(sampleTime, hostTime + mOffset);
+    mNextPoint = sampleTime + mInterval;
+  }
+
+  bool ready() const
+  {
+    return mFilter.size() >= minPoints;
+  }
+
+  // positive when the audio clock runs fast, 0 until ready
+  double ppm() const
+  {
+    if (!ready() || !(mFilter.slope() > 0.))
+    {
+      return 0.;
+    }
+    return (mNominalPeriod / mFilter.slope() - 1.) * 1.0e6;
+  }
+
+private:
+  HostTimeFilter<N> mFilter;
+  double mNominalPeriod{0.};
+  double mInterval{0.}; // samples between points
+  double mNextPoint{0.};
+  double mOffset{0.}; // added to host times since the last reanchor
+  bool mReanchor{false};
+};
+} // namespace reablink
+
+#endif // REABLINK_CLOCKDRIFTESTIMATOR_HPP
@@ -0,0 +1,72 @@
+#ifndef REABLINK_EVENTRING_HPP
+#define REABLINK_EVENTRING_HPP
+
+#include "SeqLock.hpp"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace reablink
+{
+// Fixed-size ring of the latest events, numbered from 1. One thread
+// appends, any number of readers copy events after the last number they
+// saw without consuming them, so every reader sees every event. A reader
+// more than Capacity events behind misses the oldest ones, which shows as
+// a gap in the numbers. Neither side allocates or blocks.
+template <typename T, std::size_t Capacity> class EventRing
+{
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  struct Slot
+  {
+    std::uint64_t sequence;
+    T item;
+  };
+
+  std::array<SeqLock<Slot>, Capacity> mSlots;
+  std::atomic<std::uint64_t> mLast{0};
+
+public:
+  // one thread only. Returns the number of the event.
+  std::uint64_t push(const T& item)
+  {
+    const auto sequence = mLast.load(std::memory_order_relaxed) + 1;
+    mSlots[sequence & (Capacity - 1)].store(Slot{sequence, item});
+    mLast.store(sequence, std::memory_order_release);
+    return sequence;
+  }
+
+  // number of the latest event, 0 if none
+  std::uint64_t last() const
+  {
+    return mLast.load(std::memory_order_acquire);
+  }
+
+  // first event after since that can still be read
+  std::uint64_t next(std::uint64_t since) const
+  {
+    const auto latest = last();
+    if (since >= latest)
+    {
+      return latest + 1;
+    }
+    return latest - since > Capacity ? latest - Capacity + 1 : since + 1;
+  }
+
+  // Returns false if the event is not written yet or already overwritten.
+  bool read(std::uint64_t sequence, T& item) const
+  {
+    const auto slot = mSlots[sequence & (Capacity - 1)].load();
+    if (slot.sequence != sequence)
+    {
+      return false;
+    }
+    item = slot.item;
+    return true;
+  }
+};
+} // namespace reablink
+
+#endif // REABLINK_EVENTRING_HPP
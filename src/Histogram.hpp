@@ -0,0 +1,209 @@
+#ifndef REABLINK_HISTOGRAM_HPP
+#define REABLINK_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace reablink
+{
+// Log-linear histogram of non-negative values. Each power of two between
+// 1 and 2^Octaves is split into SubBuckets linear buckets, so relative
+// resolution is 1/SubBuckets. Values below 1 share bucket 0 and values
+// above the range share the last bucket. Fixed size, add() is O(1) and
+// does not allocate. Units are up to the caller (e.g. microseconds).
+template <int Octaves = 32, int SubBuckets = 8> class LogHistogram
+{
+public:
+  static constexpr size_t bucketCount = 1 + Octaves * SubBuckets;
+
+  void add(double value)
+  {
+    ++mBuckets[bucketOf(value)];
+    ++mCount;
+    mSum += value;
+    mMin = std::min(mMin, value);
+    mMax = std::max(mMax, value);
+  }
+
+  void merge(const LogHistogram& other)
+  {
+    for (size_t i = 0; i < bucketCount; ++i)
+    {
+      mBuckets[i] += other.mBuckets[i];
+    }
+    mCount += other.mCount;
+    mSum += other.mSum;
+    mMin = std::min(mMin, other.mMin);
+    mMax = std::max(mMax, other.mMax);
+  }
+
+  void reset()
+  {
+    *this = LogHistogram{};
+  }
+
+  uint64_t count() const
+  {
+    return mCount;
+  }
+
+  double min() const
+  {
+    return mCount ? mMin : 0.;
+  }
+
+  double max() const
+  {
+    return mCount ? mMax : 0.;
+  }
+
+  double mean() const
+  {
+    return mCount ? mSum / mCount : 0.;
+  }
+
+  // upper bound of the bucket holding the p-th percentile, p in [0, 100]
+  double percentile(double p) const
+  {
+    if (mCount == 0)
+    {
+      return 0.;
+    }
+    const auto rank = std::max<uint64_t>(
+      1, (uint64_t)std::ceil(std::clamp(p, 0., 100.) / 100. * mCount));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCount; ++i)
+    {
+      seen += mBuckets[i];
+      if (seen >= rank)
+      {
+        return std::clamp(upperBound(i), mMin, mMax);
+      }
+    }
+    return mMax;
+  }
+
+  uint64_t bucket(size_t i) const
+  {
+    return mBuckets[i];
+  }
+
+  static double upperBound(size_t i)
+  {
+    if (i == 0)
+    {
+      return 1.;
+    }
+    const auto octave = (int)((i - 1) / SubBuckets);
+    const auto sub = (int)((i - 1) % SubBuckets);
+    return std::ldexp(1. + (sub + 1.) / SubBuckets, octave);
+  }
+
+  static size_t bucketOf(double value)
+  {
+    if (!(value >= 1.))
+    {
+      return 0;
+    }
+    int exponent = 0;
+    const auto mantissa = std::frexp(value, &exponent); // [0.5, 1)
+    const auto octave = exponent - 1;
+    if (octave >= Octaves)
+    {
+      return bucketCount - 1;
+    }
+    const auto sub = (int)((mantissa * 2. - 1.) * SubBuckets);
+    return 1 + (size_t)octave * SubBuckets + (size_t)sub;
+  }
+
+private:
+  template <int, int> friend class AtomicLogHistogram;
+
+  std::array<uint64_t, bucketCount> mBuckets{};
+  uint64_t mCount{0};
+  double mSum{0.};
+  double mMin{std::numeric_limits<double>::max()};
+  double mMax{0.};
+};
+
+// LogHistogram with one realtime-safe writer and any number of readers.
+// add() is wait-free and readers take snapshots. reset() is applied by the
+// writer on its next add(), so counts never mix two generations.
+template <int Octaves = 32, int SubBuckets = 8> class AtomicLogHistogram
+{
+public:
+  using Snapshot = LogHistogram<Octaves, SubBuckets>;
+
+  void add(double value)
+  {
+    if (mResetRequested.load(std::memory_order_acquire))
+    {
+      clear();
+      mResetRequested.store(false, std::memory_order_release);
+    }
+    const auto i = Snapshot::bucketOf(value);
+    relaxedIncrement(mBuckets[i]);
+    mSum.store(mSum.load(std::memory_order_relaxed) + value,
+               std::memory_order_relaxed);
+    if (value < mMin.load(std::memory_order_relaxed))
+      mMin.store(value, std::memory_order_relaxed);
+    if (value > mMax.load(std::memory_order_relaxed))
+      mMax.store(value, std::memory_order_relaxed);
+  }
+
+  void reset()
+  {
+    mResetRequested.store(true, std::memory_order_release);
+  }
+
+  Snapshot snapshot() const
+  {
+    auto result = Snapshot{};
+    if (mResetRequested.load(std::memory_order_acquire))
+    {
+      return result;
+    }
+    for (size_t i = 0; i < Snapshot::bucketCount; ++i)
+    {
+      result.mBuckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+      result.mCount += result.mBuckets[i];
+    }
+    result.mSum = mSum.load(std::memory_order_relaxed);
+    result.mMin = mMin.load(std::memory_order_relaxed);
+    result.mMax = mMax.load(std::memory_order_relaxed);
+    return result;
+  }
+
+private:
+  // single writer, so no read-modify-write instruction is needed
+  static void relaxedIncrement(std::atomic<uint64_t>& counter)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  void clear()
+  {
+    for (auto& bucket : mBuckets)
+    {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    mSum.store(0., std::memory_order_relaxed);
+    mMin.store(std::numeric_limits<double>::max(), std::memory_order_relaxed);
+    mMax.store(0., std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, Snapshot::bucketCount> mBuckets{};
+  std::atomic<double> mSum{0.};
+  std::atomic<double> mMin{std::numeric_limits<double>::max()};
+  std::atomic<double> mMax{0.};
+  std::atomic_bool mResetRequested{false};
+};
+} // namespace reablink
+
+#endif // REABLINK_HISTOGRAM_HPP
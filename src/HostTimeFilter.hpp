@@ -0,0 +1,139 @@
+#ifndef REABLINK_HOSTTIMEFILTER_HPP
+#define REABLINK_HOSTTIMEFILTER_HPP
+
+#include <array>
+#include <cstddef>
+
+namespace reablink
+{
+// Linear regression of host clock time against audio sample time over the
+// latest N audio blocks, after Link's HostTimeFilter. Callback jitter
+// averages out and the slope follows the actual audio clock rate. update()
+// is O(1): window sums are kept relative to an anchor point and rebuilt
+// from the ring once per window, so rounding errors do not accumulate.
+// Single thread, does not allocate.
+template <std::size_t N = 512> class HostTimeFilter
+{
+public:
+  // slope until two points are in, host time units per sample
+  void reset(double nominalSlope)
+  {
+    mNominalSlope = nominalSlope;
+    mCount = 0;
+    mNext = 0;
+  }
+
+  // adds a measurement, returns filtered host time of sampleTime
+  double update(double sampleTime, double hostTime)
+  {
+    if (mCount == 0)
+    {
+      mAnchorX = sampleTime;
+      mAnchorY = hostTime;
+      mSx = mSy = mSxx = mSxy = 0.;
+      mSinceAnchor = 0;
+    }
+    if (mCount == N)
+    {
+      remove(mPoints[mNext]);
+    }
+    else
+    {
+      ++mCount;
+    }
+    mPoints[mNext] = Point{sampleTime, hostTime};
+    add(mPoints[mNext]);
+    mNext = (mNext + 1) % N;
+    if (++mSinceAnchor >= N)
+    {
+      reanchor();
+    }
+    return hostTimeAt(sampleTime);
+  }
+
+  double hostTimeAt(double sampleTime) const
+  {
+    if (mCount == 0)
+    {
+      return 0.;
+    }
+    const auto meanX = mSx / mCount;
+    const auto meanY = mSy / mCount;
+    return mAnchorY + meanY + slope() * (sampleTime - mAnchorX - meanX);
+  }
+
+  double slope() const
+  {
+    if (mCount < 2)
+    {
+      return mNominalSlope;
+    }
+    const auto varX = mSxx - mSx * mSx / mCount;
+    if (!(varX > 0.))
+    {
+      return mNominalSlope;
+    }
+    return (mSxy - mSx * mSy / mCount) / varX;
+  }
+
+  std::size_t size() const
+  {
+    return mCount;
+  }
+
+private:
+  struct Point
+  {
+    double x;
+    double y;
+  };
+
+  void add(const Point& point)
+  {
+    const auto x = point.x - mAnchorX;
+    const auto y = point.y - mAnchorY;
+    mSx += x;
+    mSy += y;
+    mSxx += x * x;
+    mSxy += x * y;
+  }
+
+  void remove(const Point& point)
+  {
+    const auto x = point.x - mAnchorX;
+    const auto y = point.y - mAnchorY;
+    mSx -= x;
+    mSy -= y;
+    mSxx -= x * x;
+    mSxy -= x * y;
+  }
+
+  // oldest point becomes the anchor, keeping relative values small
+  void reanchor()
+  {
+    const auto oldest = mCount == N ? mNext : 0;
+    mAnchorX = mPoints[oldest].x;
+    mAnchorY = mPoints[oldest].y;
+    mSx = mSy = mSxx = mSxy = 0.;
+    for (std::size_t i = 0; i < mCount; ++i)
+    {
+      add(mPoints[i]);
+    }
+    mSinceAnchor = 0;
+  }
+
+  std::array<Point, N> mPoints{};
+  std::size_t mCount{0};
+  std::size_t mNext{0};
+  std::size_t mSinceAnchor{0};
+  double mNominalSlope{0.};
+  double mAnchorX{0.};
+  double mAnchorY{0.};
+  double mSx{0.};
+  double mSy{0.};
+  double mSxx{0.};
+  double mSxy{0.};
+};
+} // namespace reablink
+
+#endif // REABLINK_HOSTTIMEFILTER_HPP
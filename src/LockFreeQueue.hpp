@@ -0,0 +1,124 @@
+#ifndef REABLINK_LOCKFREEQUEUE_HPP
+#define REABLINK_LOCKFREEQUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace reablink
+{
+// Bounded wait-free single producer / single consumer queue. Neither side
+// allocates or blocks, so it is safe to push from the audio thread.
+template <typename T, std::size_t Capacity> class SpscQueue
+{
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  std::array<T, Capacity> mItems{};
+  alignas(64) std::atomic<std::size_t> mHead{0}; // next slot to read
+  alignas(64) std::atomic<std::size_t> mTail{0}; // next slot to write
+
+public:
+  // Returns false if the queue is full.
+  bool push(const T& item)
+  {
+    const auto tail = mTail.load(std::memory_order_relaxed);
+    if (tail - mHead.load(std::memory_order_acquire) == Capacity)
+    {
+      return false;
+    }
+    mItems[tail & (Capacity - 1)] = item;
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool pop(T& item)
+  {
+    const auto head = mHead.load(std::memory_order_relaxed);
+    if (head == mTail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    item = mItems[head & (Capacity - 1)];
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+// Bounded lock-free multiple producer / single consumer queue. Every slot
+// carries a sequence number telling whose turn it is, so producers only
+// contend on claiming a slot and the consumer never blocks.
+template <typename T, std::size_t Capacity> class MpscQueue
+{
+  static_assert((Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  struct Slot
+  {
+    std::atomic<std::size_t> sequence;
+    T item;
+  };
+
+  std::array<Slot, Capacity> mSlots;
+  alignas(64) std::atomic<std::size_t> mHead{0}; // next slot to read
+  alignas(64) std::atomic<std::size_t> mTail{0}; // next slot to claim
+
+public:
+  MpscQueue()
+  {
+    for (std::size_t i = 0; i < Capacity; ++i)
+    {
+      mSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns false if the queue is full.
+  bool push(const T& item)
+  {
+    auto tail = mTail.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto& slot = mSlots[tail & (Capacity - 1)];
+      const auto lag = static_cast<std::ptrdiff_t>(
+        slot.sequence.load(std::memory_order_acquire) - tail);
+      if (lag == 0)
+      {
+        if (mTail.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_relaxed))
+        {
+          slot.item = item;
+          slot.sequence.store(tail + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (lag < 0)
+      {
+        return false; // slot not yet consumed a lap ago
+      }
+      else
+      {
+        tail = mTail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Returns false if the queue is empty or the next item is still being
+  // written.
+  bool pop(T& item)
+  {
+    const auto head = mHead.load(std::memory_order_relaxed);
+    auto& slot = mSlots[head & (Capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+    {
+      return false;
+    }
+    item = slot.item;
+    slot.sequence.store(head + Capacity, std::memory_order_release);
+    mHead.store(head + 1, std::memory_order_relaxed);
+    return true;
+  }
+};
+} // namespace reablink
+
+#endif // REABLINK_LOCKFREEQUEUE_HPP
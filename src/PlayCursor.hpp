@@ -0,0 +1,80 @@
+#ifndef REABLINK_PLAYCURSOR_HPP
+#define REABLINK_PLAYCURSOR_HPP
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace reablink
+{
+// REAPER transport and tempo map around the play position, as of a timer
+// tick. The position moves linearly with host time at the playrate and
+// wraps at the loop end, so the audio thread can follow it and its beats
+// without calling REAPER. Seeks and tempo markers passed since the tick
+// are picked up by the next tick.
+struct PlayCursor
+{
+  // tempo map from start up to the next tempo marker
+  struct Segment
+  {
+    double start;
+    double end; // next tempo marker
+    double qn;  // at start
+    double beat; // at start, since start of measure
+    double bpm;  // at start
+    double ramp; // bpm per second of a linear tempo ramp, else 0
+    int num;
+    int denom;
+
+    double bpmAt(double time) const
+    {
+      return bpm + ramp * (time - start);
+    }
+
+    double qnAt(double time) const
+    {
+      const auto elapsed = time - start;
+      return qn + (bpm + 0.5 * ramp * elapsed) * elapsed / 60.;
+    }
+
+    // same as TimeMap2_timeToBeats
+    double beatAt(double time) const
+    {
+      const auto beats = beat + (qnAt(time) - qn) * denom / 4.;
+      return num > 0 ? beats - std::floor(beats / num) * num : beats;
+    }
+  };
+
+  std::chrono::microseconds time; // when position is heard, 0 if none
+  double position;
+  double playrate; // 0 when stopped
+  std::uint64_t commands; // audio thread commands run before it was taken
+  bool repeat;
+  double loopStart;
+  double loopEnd;
+  Segment segment;     // holding position
+  Segment loopSegment; // holding loopStart, valid with repeat
+
+  double positionAt(std::chrono::microseconds at) const
+  {
+    const auto moved =
+      position + (double)(at - time).count() / 1.0e6 * playrate;
+    const auto length = loopEnd - loopStart;
+    if (!repeat || !(length > 0.) || position < loopStart ||
+        position >= loopEnd || moved < loopEnd)
+    {
+      return moved;
+    }
+    return loopStart + std::fmod(moved - loopStart, length);
+  }
+
+  const Segment& segmentAt(double time) const
+  {
+    return repeat && time < segment.start && time >= loopSegment.start
+             ? loopSegment
+             : segment;
+  }
+};
+} // namespace reablink
+
+#endif // REABLINK_PLAYCURSOR_HPP
@@ -1,39 +1,193 @@
-#include <algorithm>
-#include <deque>
-#include <numeric>
+#ifndef REABLINK_ROLLINGAVERAGE_HPP
+#define REABLINK_ROLLINGAVERAGE_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Interquartile mean of the latest values. Values live in a fixed ring
+// buffer and are indexed by an order statistics treap whose nodes carry
+// subtree sizes and sums, so add() and average() are O(log n) and nothing
+// is allocated after construction.
 class RollingAverage
 {
-  std::deque<double> values;
+  struct Node
+  {
+    double value;
+    double sum;
+    uint32_t priority;
+    uint32_t size;
+    int left;
+    int right;
+  };
+
+  // node i holds the value of ring slot i
+  std::vector<Node> nodes;
   size_t maxSize;
+  size_t head{0};
+  size_t count{0};
+  int root{-1};
+
+  uint32_t size(int t) const
+  {
+    return t < 0 ? 0 : nodes[t].size;
+  }
+
+  double sum(int t) const
+  {
+    return t < 0 ? 0. : nodes[t].sum;
+  }
+
+  void update(int t)
+  {
+    auto& node = nodes[t];
+    node.size = 1 + size(node.left) + size(node.right);
+    node.sum = node.value + sum(node.left) + sum(node.right);
+  }
+
+  // strict weak order, ties broken by ring slot to keep keys unique
+  bool less(int a, int b) const
+  {
+    return nodes[a].value < nodes[b].value ||
+           (!(nodes[b].value < nodes[a].value) && a < b);
+  }
+
+  // l gets nodes ordered before key, r the rest
+  void split(int t, int key, int& l, int& r)
+  {
+    if (t < 0)
+    {
+      l = r = -1;
+      return;
+    }
+    if (less(t, key))
+    {
+      split(nodes[t].right, key, nodes[t].right, r);
+      l = t;
+    }
+    else
+    {
+      split(nodes[t].left, key, l, nodes[t].left);
+      r = t;
+    }
+    update(t);
+  }
+
+  int merge(int l, int r)
+  {
+    if (l < 0)
+      return r;
+    if (r < 0)
+      return l;
+    if (nodes[l].priority > nodes[r].priority)
+    {
+      nodes[l].right = merge(nodes[l].right, r);
+      update(l);
+      return l;
+    }
+    nodes[r].left = merge(l, nodes[r].left);
+    update(r);
+    return r;
+  }
+
+  int insert(int t, int node)
+  {
+    if (t < 0)
+      return node;
+    if (nodes[node].priority > nodes[t].priority)
+    {
+      split(t, node, nodes[node].left, nodes[node].right);
+      update(node);
+      return node;
+    }
+    if (less(node, t))
+      nodes[t].left = insert(nodes[t].left, node);
+    else
+      nodes[t].right = insert(nodes[t].right, node);
+    update(t);
+    return t;
+  }
+
+  int erase(int t, int node)
+  {
+    if (t == node)
+      return merge(nodes[t].left, nodes[t].right);
+    if (less(node, t))
+      nodes[t].left = erase(nodes[t].left, node);
+    else
+      nodes[t].right = erase(nodes[t].right, node);
+    update(t);
+    return t;
+  }
+
+  // sum of k smallest values
+  double sumSmallest(size_t k) const
+  {
+    double result = 0.;
+    int t = root;
+    while (t >= 0 && k > 0)
+    {
+      const auto& node = nodes[t];
+      const size_t leftSize = size(node.left);
+      if (k <= leftSize)
+      {
+        t = node.left;
+        continue;
+      }
+      result += sum(node.left) + node.value;
+      k -= leftSize + 1;
+      t = node.right;
+    }
+    return result;
+  }
 
 public:
-  RollingAverage(size_t size) : maxSize(size)
+  RollingAverage(size_t size) : nodes(size > 0 ? size : 1), maxSize(size)
   {
+    if (maxSize == 0)
+    {
+      maxSize = 1;
+    }
+    // fixed seed keeps tree shapes reproducible
+    uint32_t seed = 0x9E3779B9u;
+    for (auto& node : nodes)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      node = Node{0., 0., seed, 1, -1, -1};
+    }
   }
 
   void add(double value)
   {
-    if (values.size() == maxSize)
+    const auto slot = static_cast<int>(head);
+    if (count == maxSize)
+    {
+      root = erase(root, slot); // Remove oldest value
+    }
+    else
     {
-      values.pop_front(); // Remove oldest value
+      ++count;
     }
-    values.push_back(value); // Add new value
+    nodes[slot].value = value;
+    nodes[slot].left = nodes[slot].right = -1;
+    update(slot);
+    root = insert(root, slot); // Add new value
+    head = (head + 1) % maxSize;
   }
 
   double average() const
   {
-    if (values.empty())
+    if (count == 0)
     {
-      return 0.0; // Return 0 if the deque is empty to avoid division by zero
+      return 0.0; // Return 0 if empty to avoid division by zero
     }
 
-    std::deque<double> sortedValues = values;
-    std::sort(sortedValues.begin(), sortedValues.end());
-
-    size_t quarter = sortedValues.size() / 4;
-    double sum = std::accumulate(sortedValues.begin() + quarter,
-                                 sortedValues.end() - quarter, 0.0);
-    return sum / (sortedValues.size() - 2 * quarter);
+    size_t quarter = count / 4;
+    double sum = sumSmallest(count - quarter) - sumSmallest(quarter);
+    return sum / (count - 2 * quarter);
   }
-};
\ No newline at end of file
+};
+
+#endif // REABLINK_ROLLINGAVERAGE_HPP
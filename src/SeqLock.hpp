@@ -0,0 +1,75 @@
+#ifndef REABLINK_SEQLOCK_HPP
+#define REABLINK_SEQLOCK_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace reablink
+{
+// Single writer value that readers copy without locking. The writer makes
+// the sequence odd while it stores, readers retry when the sequence was
+// odd or changed during their copy. The value is kept in atomic words so
+// a torn copy is discarded, never undefined. Writes do not wait, reads
+// only repeat when they overlap a write.
+template <typename T> class SeqLock
+{
+  static constexpr std::size_t Words =
+    (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+  std::array<std::atomic<std::uint64_t>, Words> mWords{};
+  std::atomic<std::uint64_t> mSequence{0};
+
+public:
+  SeqLock()
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "T must be trivially copyable");
+    store(T{});
+  }
+
+  // one thread only
+  void store(const T& value)
+  {
+    std::array<std::uint64_t, Words> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+    const auto sequence = mSequence.load(std::memory_order_relaxed);
+    mSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < Words; ++i)
+    {
+      mWords[i].store(words[i], std::memory_order_relaxed);
+    }
+    mSequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  T load() const
+  {
+    std::array<std::uint64_t, Words> words{};
+    while (true)
+    {
+      const auto sequence = mSequence.load(std::memory_order_acquire);
+      if ((sequence & 1) != 0)
+      {
+        continue;
+      }
+      for (std::size_t i = 0; i < Words; ++i)
+      {
+        words[i] = mWords[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (mSequence.load(std::memory_order_relaxed) == sequence)
+      {
+        break;
+      }
+    }
+    T value{};
+    std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+    return value;
+  }
+};
+} // namespace reablink
+
+#endif // REABLINK_SEQLOCK_HPP
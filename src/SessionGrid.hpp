@@ -0,0 +1,41 @@
+#ifndef REABLINK_SESSIONGRID_HPP
+#define REABLINK_SESSIONGRID_HPP
+
+#include <ableton/Link.hpp>
+#include <chrono>
+
+namespace reablink
+{
+// Link session timeline at one point in time. Beats are linear in time
+// until the session changes, so the audio thread can place beats
+// sample-accurately from a grid without capturing the session state on
+// every block.
+struct SessionGrid
+{
+  bool playing;
+  std::chrono::microseconds startTime; // of playing, or of stopping
+  std::chrono::microseconds time;
+  double beat; // at time
+  double tempo;
+  double quantum;
+
+  static SessionGrid of(const ableton::Link::SessionState& sessionState,
+                        std::chrono::microseconds time,
+                        double quantum)
+  {
+    return SessionGrid{sessionState.isPlaying(),
+                       sessionState.timeForIsPlaying(),
+                       time,
+                       sessionState.beatAtTime(time, quantum),
+                       sessionState.tempo(),
+                       quantum};
+  }
+
+  double beatAt(std::chrono::microseconds at) const
+  {
+    return beat + (double)(at - time).count() * tempo / 60.0e6;
+  }
+};
+} // namespace reablink
+
+#endif // REABLINK_SESSIONGRID_HPP
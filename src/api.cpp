@@ -1,16 +1,23 @@
 #include "api.hpp"
 #include "config.h"
 
+#include "ApiRegistry.hpp"
+#include "HostTimeFilter.hpp"
+#include "command_table.hpp"
 #include "engine.hpp"
 
 #include "global_vars.hpp"
+#include "tick_thread.hpp"
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <mutex>
 #include <stdio.h>
 
 #include <reaper_plugin_functions.h>
 
-#include "reascript_vararg.hpp"
-
 namespace reablink
 {
 using namespace ableton;
@@ -41,15 +48,33 @@ struct LinkSession
     {
       getInstance().audioPlatform.mEngine.setTempo(bpm);
     }
+    getInstance().audioPlatform.mEngine.postEvent(
+      AudioEngine::Event::Type::Tempo, bpm);
+  }
+
+  static void NumPeersCallback(std::size_t numPeers)
+  {
+    getInstance().audioPlatform.mEngine.postEvent(
+      AudioEngine::Event::Type::NumPeers, (double)numPeers);
   }
 
-  // register on REAPER timer
+  static void StartStopCallback(bool isPlaying)
+  {
+    getInstance().audioPlatform.mEngine.postEvent(
+      AudioEngine::Event::Type::Playing, isPlaying ? 1. : 0.);
+  }
+
+  // sync loop tick, posted to the main thread by the tick thread. The tick
+  // runs after the latest audio block was processed, so REAPER's play
+  // position is already that of the block after it, heard one block later
+  // than the latest block.
   static void audioCallback()
   {
     getInstance().audioPlatform.mEngine.audioCallback(
       std::chrono::microseconds(llround(
         ( //
-          g_abuf_time + GetOutputLatency() + g_abuf_len / g_abuf_srate) *
+          g_abuf_time + getInstance().audioPlatform.mEngine.outputLatency() +
+          2 * g_abuf_len * g_abuf_sample_period) *
         1.0e6)),
       g_abuf_len);
   }
@@ -58,33 +83,78 @@ private:
   LinkSession()
   {
     this->link.setTempoCallback(TempoCallback);
+    this->link.setNumPeersCallback(NumPeersCallback);
+    this->link.setStartStopCallback(StartStopCallback);
   }
 };
 
-UINT_PTR timerId;
+HWND mainWindow{nullptr};
+int tickCommand{0}; // command id the tick thread posts
+TickThread tickThread;
 
-void CALLBACK timerTick(HWND hwnd, UINT msg, UINT_PTR timerIdIn, DWORD time)
+bool runTick(int command, int flag)
 {
-  (void)hwnd;
-  (void)msg;
-  (void)time;
-  if (timerIdIn == timerId)
+  (void)flag;
+  if (!tickThread.handle(command))
   {
-    LinkSession::getInstance().audioCallback();
+    return false;
   }
+  LinkSession::getInstance().audioCallback();
+  // the engine picks the rate of the next ticks
+  tickThread.setInterval(
+    LinkSession::getInstance().audioPlatform.mEngine.tickInterval());
+  return true;
 }
 
 static void OnAudioBuffer(bool isPost, int len, double srate,
                           struct audio_hook_register_t* reg)
 {
   static const auto& clock = LinkSession::getInstance().link.clock();
+  static auto& engine = LinkSession::getInstance().audioPlatform.mEngine;
+  // audio thread only
+  static HostTimeFilter<> filter;
+  static double sampleTime{0.};
+  // when the block is heard
+  static std::chrono::microseconds hostTime{0};
   if (!isPost)
   {
+    const auto now = (double)clock.micros().count();
+    // device restart, dropout or sample rate change
+    const auto tolerance = (2. * len / srate + 0.01) * 1.0e6;
+    const auto reset =
+      srate != g_abuf_srate ||
+      std::abs(now - filter.hostTimeAt(sampleTime)) > tolerance;
+    if (reset)
+    {
+      filter.reset(1.0e6 / srate);
+    }
+    const auto time = filter.update(sampleTime, now) / 1.0e6;
+    engine.updateClockDrift(reset, sampleTime, time * 1.0e6, srate);
+    sampleTime += len;
     g_abuf_len = len;
     g_abuf_srate = srate;
-    g_abuf_time = (double)clock.micros().count() / 1.0e6;
+    g_abuf_sample_period = filter.slope() / 1.0e6;
+    g_abuf_time = time;
+    hostTime = std::chrono::microseconds(llround(
+      (time + engine.outputLatency() + len * g_abuf_sample_period) * 1.0e6));
+
+    // real-time sync, once per audio block once the timer tick handed the
+    // sync loop over
+    engine.audioBlockCallback(hostTime, len);
+    engine.midiClockCallback(hostTime, len);
+  }
+  else
+  {
+    // output buffers hold REAPER's mix now
+    int channel{0};
+    if (engine.getMetronome(&channel, nullptr) && channel < reg->output_nch)
+    {
+      engine.metronomeCallback(
+        hostTime, len, reg->GetBuffer(true, channel),
+        channel + 1 < reg->output_nch ? reg->GetBuffer(true, channel + 1)
+                                      : nullptr);
+    }
   }
-  (void)reg;
 }
 
 LinkSession* link_session{nullptr};
@@ -102,9 +172,26 @@ double microsToDouble(std::chrono::microseconds time)
   return std::chrono::duration<double>(time).count();
 }
 
-const char* defstring_SetMakeReaperGoBrrr =
-  "void\0int*\0rateInOptional\0"
-  "Increases REAPER timer rate. Rate is desired frame time in ms. ";
+// Session state for getters. While Blink is enabled the engine publishes
+// it every timer tick, reading that takes no lock.
+static Link::SessionState captureSessionState()
+{
+  auto& session = LinkSession::getInstance();
+  const auto snapshot = session.audioPlatform.mEngine.snapshot();
+  return snapshot.sessionState ? *snapshot.sessionState
+                               : session.link.captureAppSessionState();
+}
+
+// getters see the change before the next tick
+static void commitSessionState(const Link::SessionState& sessionState)
+{
+  auto& session = LinkSession::getInstance();
+  session.link.commitAppSessionState(sessionState);
+  if (session.link.isEnabled())
+  {
+    session.audioPlatform.mEngine.publishSnapshot(sessionState);
+  }
+}
 
 /*! @brief Get timeline offset.
  *  Thread-safe: yes
@@ -116,10 +203,10 @@ double GetTimelineOffset()
   return g_timeline_offset_reablink;
 }
 
-const char* defstring_GetTimelineOffset =
-  "double\0\0\0"
-  "Get timeline offset. This is the offset between "
-  "REAPER timeline and Link session timeline.";
+constexpr ApiDoc doc_GetTimelineOffset{
+  "Blink_GetTimelineOffset", "",
+  "Get timeline offset. This is the offset between REAPER timeline and Link "
+  "session timeline."};
 
 /*! @brief Get audio buffer timing information.
  *  Thread-safe: yes
@@ -133,11 +220,30 @@ void GetAudioBufferTimingInfo(int* lenOut, double* srateOut, double* timeOut)
   *timeOut = g_abuf_time;
 }
 
-const char* defstring_GetAudioBufferTimingInfo =
-  "void\0int*,double*,double*\0lenOut,srateOut,timeOut\0"
+constexpr ApiDoc doc_GetAudioBufferTimingInfo{
+  "Blink_GetAudioBufferTimingInfo", "lenOut,srateOut,timeOut",
   "Get audio buffer timing information. This is the length (size) of audio "
   "buffer in samples, sample rate and 'latest audio buffer switch wall clock "
-  "time' in seconds.";
+  "time' in seconds. The time is fitted to the audio sample count over the "
+  "latest 512 buffers, so buffer switch jitter is filtered out."};
+
+/*! @brief Get Link clock time of a sample in the current audio buffer.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+double GetAudioBufferSampleTime(int sample)
+{
+  return g_abuf_time +
+         LinkSession::getInstance().audioPlatform.mEngine.outputLatency() +
+         (g_abuf_len + sample) * g_abuf_sample_period;
+}
+
+constexpr ApiDoc doc_GetAudioBufferSampleTime{
+  "Blink_GetAudioBufferSampleTime", "sample",
+  "Get Link clock time at which the given sample offset of the latest audio "
+  "buffer is heard from speakers, in seconds. Derived from a regression of "
+  "audio sample count against clock time, accurate to well below a "
+  "millisecond."};
 
 /*! @brief Is Link currently enabled?
  *  Thread-safe: yes
@@ -148,8 +254,9 @@ bool GetEnabled()
   return LinkSession::getInstance().link.isEnabled();
 }
 
-const char* defstring_GetEnabled = "bool\0\0\0"
-                                   "Is Blink currently enabled?";
+constexpr ApiDoc doc_GetEnabled{
+  "Blink_GetEnabled", "",
+  "Is Blink currently enabled?"};
 
 /*! @brief Enable/disable Link.
  *  Thread-safe: yes
@@ -160,23 +267,28 @@ void SetEnabled(bool enable)
   static audio_hook_register_t audio_hook{OnAudioBuffer, 0, 0, 0, 0, 0};
   LinkSession::getInstance().running = enable;
   LinkSession::getInstance().link.enable(enable);
-  if (enable)
+  LinkSession::getInstance().audioPlatform.mEngine.clearSnapshot();
+  if (enable && !tickThread.running())
   {
     Audio_RegHardwareHook(true, &audio_hook);
-    timerId = SetTimer(nullptr, 0, 12, &timerTick);
+    plugin_register("hookcommand", (void*)runTick);
+    tickThread.start(
+      mainWindow, tickCommand,
+      LinkSession::getInstance().audioPlatform.mEngine.tickInterval());
   }
-  else
+  else if (!enable && tickThread.running())
   {
+    // reverse order of registration
+    tickThread.stop();
+    plugin_register("-hookcommand", (void*)runTick);
     Audio_RegHardwareHook(false, &audio_hook);
-    KillTimer(nullptr, timerId);
   }
 }
 
-const char* defstring_SetEnabled =
-  "void\0bool\0enable\0"
-  "Enable/disable Blink. In Blink methods "
-  "transport, tempo and timeline refer "
-  "to Link session, not local REAPER instance.";
+constexpr ApiDoc doc_SetEnabled{
+  "Blink_SetEnabled", "enable",
+  "Enable/disable Blink. In Blink methods transport, tempo and timeline refer "
+  "to Link session, not local REAPER instance."};
 
 /*! @brief: Is start/stop synchronization enabled?
  *  Thread-safe: yes
@@ -187,9 +299,9 @@ bool GetStartStopSyncEnabled()
   return LinkSession::getInstance().link.isStartStopSyncEnabled();
 }
 
-const char* defstring_GetStartStopSyncEnabled =
-  "bool\0\0\0"
-  "Is start/stop synchronization enabled?";
+constexpr ApiDoc doc_GetStartStopSyncEnabled{
+  "Blink_GetStartStopSyncEnabled", "",
+  "Is start/stop synchronization enabled?"};
 
 /*! @brief: Enable start/stop synchronization.
  *  Thread-safe: yes
@@ -200,9 +312,9 @@ void SetStartStopSyncEnabled(bool enable)
   LinkSession::getInstance().link.enableStartStopSync(enable);
 }
 
-const char* defstring_SetStartStopSyncEnabled =
-  "void\0bool\0enable\0"
-  "Enable start/stop synchronization.";
+constexpr ApiDoc doc_SetStartStopSyncEnabled{
+  "Blink_SetStartStopSyncEnabled", "enable",
+  "Enable start/stop synchronization."};
 
 /*! @brief How many peers are currently connected
  * in a Link session? Thread-safe: yes
@@ -213,9 +325,9 @@ int GetNumPeers()
   return (int)LinkSession::getInstance().link.numPeers();
 }
 
-const char* defstring_GetNumPeers = "int\0\0\0"
-                                    "How many peers are currently connected in "
-                                    "Link session?";
+constexpr ApiDoc doc_GetNumPeers{
+  "Blink_GetNumPeers", "",
+  "How many peers are currently connected in Link session?"};
 
 /*! @brief The clock used by Link.
  *  Thread-safe: yes
@@ -235,8 +347,9 @@ double GetClockNow()
          1.0e6;
 }
 
-const char* defstring_GetClockNow = "double\0\0\0"
-                                    "Clock used by Blink.";
+constexpr ApiDoc doc_GetClockNow{
+  "Blink_GetClockNow", "",
+  "Clock used by Blink."};
 
 /*! @brief: The tempo of the timeline, in Beats
  * Per Minute.
@@ -248,12 +361,12 @@ const char* defstring_GetClockNow = "double\0\0\0"
  */
 double GetTempo()
 {
-  return LinkSession::getInstance().link.captureAppSessionState().tempo();
+  return captureSessionState().tempo();
 }
 
-const char* defstring_GetTempo = "double\0\0\0"
-                                 "Tempo of timeline, in quarter note Beats Per "
-                                 "Minute.";
+constexpr ApiDoc doc_GetTempo{
+  "Blink_GetTempo", "",
+  "Tempo of timeline, in quarter note Beats Per Minute."};
 
 /*! @brief: Set the timeline tempo to the given
  * bpm value.
@@ -262,11 +375,12 @@ void SetTempo(double bpm)
 {
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.setTempo(bpm, LinkSession::getInstance().link.clock().micros());
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetTempo = "void\0double\0bpm\0"
-                                 "Set timeline tempo to given bpm value.";
+constexpr ApiDoc doc_SetTempo{
+  "Blink_SetTempo", "bpm",
+  "Set timeline tempo to given bpm value."};
 
 /*! @brief: Set the timeline tempo to the given
  * bpm value, taking effect at the given time.
@@ -275,13 +389,13 @@ void SetTempoAtTime(double bpm, double time)
 {
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.setTempo(bpm, doubleToMicros(time));
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetTempoAtTime =
-  "void\0double,double\0bpm,time\0"
-  "Set tempo to given bpm value, taking effect (heard from speakers)"
-  "at given wall clock time.";
+constexpr ApiDoc doc_SetTempoAtTime{
+  "Blink_SetTempoAtTime", "bpm,time",
+  "Set tempo to given bpm value, taking effect (heard from speakers)at given "
+  "wall clock time."};
 
 /*! @brief: Get the beat value corresponding to
  * the given time for the given quantum.
@@ -296,14 +410,12 @@ const char* defstring_SetTempoAtTime =
  */
 double GetBeatAtTime(double time, double quantum)
 {
-  return LinkSession::getInstance().link.captureAppSessionState().beatAtTime(
-    doubleToMicros(time), quantum);
+  return captureSessionState().beatAtTime(doubleToMicros(time), quantum);
 }
 
-const char* defstring_GetBeatAtTime =
-  "double\0double,double\0time,quantum\0"
-  "Get session beat value corresponding to given "
-  "time for given quantum.";
+constexpr ApiDoc doc_GetBeatAtTime{
+  "Blink_GetBeatAtTime", "time,quantum",
+  "Get session beat value corresponding to given time for given quantum."};
 
 /*! @brief: Get the session phase at the given
  * time for the given quantum.
@@ -318,14 +430,12 @@ const char* defstring_GetBeatAtTime =
  */
 double GetPhaseAtTime(double time, double quantum)
 {
-  return LinkSession::getInstance().link.captureAppSessionState().phaseAtTime(
-    doubleToMicros(time), quantum);
+  return captureSessionState().phaseAtTime(doubleToMicros(time), quantum);
 }
 
-const char* defstring_GetPhaseAtTime =
-  "double\0double,double\0time,quantum\0"
-  "Get session phase at given time for given "
-  "quantum.";
+constexpr ApiDoc doc_GetPhaseAtTime{
+  "Blink_GetPhaseAtTime", "time,quantum",
+  "Get session phase at given time for given quantum."};
 
 /*! @brief: Get the time at which the given beat
  * occurs for the given quantum.
@@ -336,15 +446,126 @@ const char* defstring_GetPhaseAtTime =
  */
 double GetTimeAtBeat(double beat, double quantum)
 {
-  return microsToDouble(
-    LinkSession::getInstance().link.captureAppSessionState().timeAtBeat(
-      beat, quantum));
+  return microsToDouble(captureSessionState().timeAtBeat(beat, quantum));
 }
 
-const char* defstring_GetTimeAtBeat =
-  "double\0double,double\0beat,quantum\0"
-  "Get time at which given beat occurs for given "
-  "quantum.";
+constexpr ApiDoc doc_GetTimeAtBeat{
+  "Blink_GetTimeAtBeat", "beat,quantum",
+  "Get time at which given beat occurs for given quantum."};
+
+// Beat/time line of one session capture. Within a capture beats are linear
+// in time, so array queries need a single Link lookup and the per item
+// work is a multiply-add the compiler can vectorize. Results match the
+// per call functions to Link's micro-beat resolution.
+struct BeatLine
+{
+  double time;
+  double beat;
+  double beatsPerSecond;
+};
+
+static BeatLine captureBeatLine(double time, double quantum)
+{
+  const auto sessionState = captureSessionState();
+  const auto micros = doubleToMicros(time);
+  return BeatLine{microsToDouble(micros),
+                  sessionState.beatAtTime(micros, quantum),
+                  sessionState.tempo() / 60.};
+}
+
+static unsigned int arrayCount(reaper_array* in, reaper_array* out)
+{
+  const auto count = std::min(in->size, out->alloc);
+  out->size = count;
+  return count;
+}
+
+/*! @brief: Get beats at given times for the given
+ * quantum, from one session capture.
+ *  Thread-safe: yes
+ *  Realtime-safe: no
+ */
+int GetBeatsAtTimes(reaper_array* times, reaper_array* beatsOut,
+                    double quantum)
+{
+  const auto count = arrayCount(times, beatsOut);
+  if (count == 0 || !(quantum > 0.))
+  {
+    return 0;
+  }
+  const auto line = captureBeatLine(times->data[0], quantum);
+  const auto* in = times->data;
+  auto* out = beatsOut->data;
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    out[i] = line.beat + (in[i] - line.time) * line.beatsPerSecond;
+  }
+  return (int)count;
+}
+
+constexpr ApiDoc doc_GetBeatsAtTimes{
+  "Blink_GetBeatsAtTimes", "times,beatsOut,quantum",
+  "Array version of Blink_GetBeatAtTime. Fills beatsOut with session beats at "
+  "times for given quantum, all from one session capture. Returns number of "
+  "values written, at most the allocated size of beatsOut."};
+
+/*! @brief: Get session phases at given times for
+ * the given quantum, from one session capture.
+ *  Thread-safe: yes
+ *  Realtime-safe: no
+ */
+int GetPhasesAtTimes(reaper_array* times, reaper_array* phasesOut,
+                     double quantum)
+{
+  const auto count = GetBeatsAtTimes(times, phasesOut, quantum);
+  auto* out = phasesOut->data;
+  for (int i = 0; i < count; ++i)
+  {
+    // in [0, quantum) for negative beats too
+    out[i] -= quantum * std::floor(out[i] / quantum);
+  }
+  return count;
+}
+
+constexpr ApiDoc doc_GetPhasesAtTimes{
+  "Blink_GetPhasesAtTimes", "times,phasesOut,quantum",
+  "Array version of Blink_GetPhaseAtTime. Fills phasesOut with session phases "
+  "at times for given quantum, all from one session capture. Returns number of "
+  "values written, at most the allocated size of phasesOut."};
+
+/*! @brief: Get times at which given beats occur
+ * for the given quantum, from one session capture.
+ *  Thread-safe: yes
+ *  Realtime-safe: no
+ */
+int GetTimesAtBeats(reaper_array* beats, reaper_array* timesOut,
+                    double quantum)
+{
+  const auto count = arrayCount(beats, timesOut);
+  if (count == 0 || !(quantum > 0.))
+  {
+    return 0;
+  }
+  const auto sessionState = captureSessionState();
+  const auto anchor = sessionState.timeAtBeat(beats->data[0], quantum);
+  const auto line = BeatLine{microsToDouble(anchor),
+                             sessionState.beatAtTime(anchor, quantum),
+                             sessionState.tempo() / 60.};
+  const auto secondsPerBeat = 1. / line.beatsPerSecond;
+  const auto* in = beats->data;
+  auto* out = timesOut->data;
+  for (unsigned int i = 0; i < count; ++i)
+  {
+    out[i] = line.time + (in[i] - line.beat) * secondsPerBeat;
+  }
+  return (int)count;
+}
+
+constexpr ApiDoc doc_GetTimesAtBeats{
+  "Blink_GetTimesAtBeats", "beats,timesOut,quantum",
+  "Array version of Blink_GetTimeAtBeat. Fills timesOut with times at which "
+  "beats occur for given quantum, all from one session capture. Returns number "
+  "of values written, at most the allocated size of timesOut."};
 
 /*! @brief: Attempt to map the given beat to the
  * given time in the context of the given quantum.
@@ -384,13 +605,12 @@ void SetBeatAtTimeRequest(double beat, double time, double quantum)
 {
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.requestBeatAtTime(beat, doubleToMicros(time), quantum);
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetBeatAtTimeRequest =
-  "void\0double,double,double\0bpm,time,quantum\0"
-  "Attempt to map given beat to given time in "
-  "context of given quantum.";
+constexpr ApiDoc doc_SetBeatAtTimeRequest{
+  "Blink_SetBeatAtTimeRequest", "bpm,time,quantum",
+  "Attempt to map given beat to given time in context of given quantum."};
 
 /*! @brief: Rudely re-map the beat/time
  * relationship for all peers in a session.
@@ -421,13 +641,12 @@ void SetBeatAtTimeForce(double beat, double time, double quantum)
 {
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.forceBeatAtTime(beat, doubleToMicros(time), quantum);
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetBeatAtTimeForce =
-  "void\0double,double,double\0bpm,time,quantum\0"
-  "Rudely re-map beat/time relationship for all "
-  "peers in Link session.";
+constexpr ApiDoc doc_SetBeatAtTimeForce{
+  "Blink_SetBeatAtTimeForce", "bpm,time,quantum",
+  "Rudely re-map beat/time relationship for all peers in Link session."};
 
 /*! @brief: Set if transport should be playing or
  * stopped, taking effect at the given time.
@@ -436,35 +655,126 @@ void SetPlaying(bool playing, double time)
 {
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.setIsPlaying(playing, doubleToMicros(time));
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetPlaying = "void\0bool,double\0playing,time\0"
-                                   "Set if transport should be playing or "
-                                   "stopped, taking effect at given time.";
+constexpr ApiDoc doc_SetPlaying{
+  "Blink_SetPlaying", "playing,time",
+  "Set if transport should be playing or stopped, taking effect at given "
+  "time."};
 
 /*! @brief: Is transport playing? */
 bool GetPlaying()
 {
-  return LinkSession::getInstance().link.captureAppSessionState().isPlaying();
+  return captureSessionState().isPlaying();
 }
 
-const char* defstring_GetPlaying = "bool\0\0\0"
-                                   "Is transport playing?";
+constexpr ApiDoc doc_GetPlaying{
+  "Blink_GetPlaying", "",
+  "Is transport playing?"};
+
+/*! @brief: Get Link session changes after a sequence number.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ *
+ *  @discussion: Changes are recorded by Link
+ * callbacks as they happen, so polling them is
+ * cheaper than comparing full session state.
+ */
+int PollEvents(int sinceSeq, reaper_array* eventsOut)
+{
+  constexpr auto valuesPerEvent = 4u;
+  constexpr auto maxEvents = 64;
+  std::uint64_t sequences[maxEvents];
+  AudioEngine::Event events[maxEvents];
+  const auto count = std::min((int)(eventsOut->alloc / valuesPerEvent),
+                              maxEvents);
+  const auto polled =
+    LinkSession::getInstance().audioPlatform.mEngine.pollEvents(
+      (std::uint64_t)std::max(sinceSeq, 0), sequences, events, count);
+  auto* out = eventsOut->data;
+  for (int i = 0; i < polled; ++i)
+  {
+    *out++ = (double)sequences[i];
+    *out++ = (double)events[i].type;
+    *out++ = events[i].value;
+    *out++ = microsToDouble(events[i].time);
+  }
+  eventsOut->size = polled * valuesPerEvent;
+  return polled;
+}
+
+constexpr ApiDoc doc_PollEvents{
+  "Blink_PollEvents", "sinceSeq,eventsOut",
+  "Get Link session changes after sequence number sinceSeq, oldest first. "
+  "Fills eventsOut with four values per event: sequence number, type (1 "
+  "tempo, 2 number of peers, 3 playing), new value and time it was reported. "
+  "Returns number of events, at most 64 and what fits in eventsOut. Pass the "
+  "last sequence number seen to get only newer events, 0 for all held. The "
+  "latest 256 events are held, a gap in sequence numbers means events were "
+  "missed. Playing changes are reported when start/stop sync is enabled."};
+
+/*! @brief: Get session state from a single capture.
+ *  Thread-safe: yes
+ *  Realtime-safe: no
+ *
+ *  @discussion: All values refer to the same
+ * session state, unlike separate getter calls
+ * which each capture their own.
+ */
+void GetSessionSnapshot(bool* enabledOut, int* numPeersOut,
+                        bool* startStopSyncOut, bool* playingOut,
+                        double* tempoOut, double* quantumOut, double* beatOut,
+                        double* phaseOut, double* offsetOut,
+                        double* timeInOutOptional)
+{
+  auto& session = LinkSession::getInstance();
+  const auto time = timeInOutOptional && *timeInOutOptional > 0.
+                      ? doubleToMicros(*timeInOutOptional)
+                      : session.link.clock().micros();
+  const auto quantum = session.audioPlatform.mEngine.quantum();
+  const auto snapshot = session.audioPlatform.mEngine.snapshot();
+  const auto sessionState = snapshot.sessionState
+                              ? *snapshot.sessionState
+                              : session.link.captureAppSessionState();
+  *enabledOut = session.link.isEnabled();
+  *numPeersOut = snapshot.sessionState ? (int)snapshot.numPeers
+                                       : (int)session.link.numPeers();
+  *startStopSyncOut = session.link.isStartStopSyncEnabled();
+  *playingOut = sessionState.isPlaying();
+  *tempoOut = sessionState.tempo();
+  *quantumOut = quantum;
+  *beatOut = sessionState.beatAtTime(time, quantum);
+  *phaseOut = sessionState.phaseAtTime(time, quantum);
+  *offsetOut = g_timeline_offset_reablink;
+  if (timeInOutOptional)
+  {
+    *timeInOutOptional = microsToDouble(time);
+  }
+}
+
+constexpr ApiDoc doc_GetSessionSnapshot{
+  "Blink_GetSessionSnapshot",
+  "enabledOut,numPeersOut,startStopSyncOut,playingOut,tempoOut,quantumOut,"
+  "beatOut,phaseOut,offsetOut,timeInOutOptional",
+  "Get Blink state from one session capture: enabled, number of peers, "
+  "start/stop sync, playing, tempo, quantum, beat and phase at time for "
+  "quantum, and timeline offset. Time defaults to now and is in/out, the "
+  "time used is returned after the offset. Values are consistent with each "
+  "other, unlike separate getter calls. While Blink is enabled, session "
+  "values are as of the last sync tick or Blink session change, and getters "
+  "read them without locking."};
 
 /*! @brief: Get the time at which a transport
  * start/stop occurs */
 double GetTimeForPlaying()
 {
-  return microsToDouble(LinkSession::getInstance()
-                          .link.captureAppSessionState()
-                          .timeForIsPlaying());
+  return microsToDouble(captureSessionState().timeForIsPlaying());
 }
 
-const char* defstring_GetTimeForPlaying =
-  "double\0\0\0"
-  "Get time at which transport start/stop "
-  "occurs.";
+constexpr ApiDoc doc_GetTimeForPlaying{
+  "Blink_GetTimeForPlaying", "",
+  "Get time at which transport start/stop occurs."};
 
 /*! @brief: Convenience function to attempt to map
  * the given beat to the time when transport is
@@ -476,16 +786,14 @@ void SetBeatAtStartPlayingTimeRequest(double beat, double quantum)
 {
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.requestBeatAtStartPlayingTime(beat, quantum);
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetBeatAtStartPlayingTimeRequest =
-  "void\0double,double\0beat,quantum\0"
-  "Convenience function to attempt to map "
-  "given beat to time when transport is "
-  "starting to play in context of given "
-  "quantum. This function evaluates to a "
-  "no-op if GetPlaying() equals false.";
+constexpr ApiDoc doc_SetBeatAtStartPlayingTimeRequest{
+  "Blink_SetBeatAtStartPlayingTimeRequest", "beat,quantum",
+  "Convenience function to attempt to map given beat to time when transport is "
+  "starting to play in context of given quantum. This function evaluates to a "
+  "no-op if GetPlaying() equals false."};
 
 /*! @brief: Convenience function to start or stop
  * transport at a given time and attempt to map
@@ -498,22 +806,17 @@ void SetPlayingAndBeatAtTimeRequest(bool playing, double time, double beat,
   auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
   sessionState.setIsPlayingAndRequestBeatAtTime(playing, doubleToMicros(time),
                                                 beat, quantum);
-  LinkSession::getInstance().link.commitAppSessionState(sessionState);
+  commitSessionState(sessionState);
 }
 
-const char* defstring_SetPlayingAndBeatAtTimeRequest =
-  "void\0bool,double,double,double\0playing,"
-  "time,beat,"
-  "quantum\0"
-  "Convenience function to start or stop "
-  "transport at given time and attempt "
-  "to map given beat to this time in context "
-  "of given quantum.";
+constexpr ApiDoc doc_SetPlayingAndBeatAtTimeRequest{
+  "Blink_SetPlayingAndBeatAtTimeRequest", "playing,time,beat,quantum",
+  "Convenience function to start or stop transport at given time and attempt "
+  "to map given beat to this time in context of given quantum."};
 
 void startStop()
 {
-  auto sessionState = LinkSession::getInstance().link.captureAppSessionState();
-  if (sessionState.isPlaying())
+  if (captureSessionState().isPlaying())
   {
     LinkSession::getInstance().audioPlatform.mEngine.stopPlaying();
   }
@@ -523,203 +826,488 @@ void startStop()
   }
 }
 
-const char* defstring_startStop = "void\0\0\0"
-                                  "Transport start/stop.";
+constexpr ApiDoc doc_startStop{
+  "Blink_StartStop", "",
+  "Transport start/stop."};
 
 void SetQuantum(double quantum)
 {
   LinkSession::getInstance().audioPlatform.mEngine.setQuantum(quantum);
 }
 
-const char* defstring_SetQuantum = "void\0double\0quantum\0"
-                                   "Set quantum. Usually this is set to length "
-                                   "of one measure/bar in quarter notes.";
+constexpr ApiDoc doc_SetQuantum{
+  "Blink_SetQuantum", "quantum",
+  "Set quantum. Usually this is set to length of one measure/bar in quarter "
+  "notes."};
 
 double GetQuantum()
 {
   return LinkSession::getInstance().audioPlatform.mEngine.quantum();
 }
 
-const char* defstring_GetQuantum = "double\0\0\0"
-                                   "Get quantum.";
+constexpr ApiDoc doc_GetQuantum{
+  "Blink_GetQuantum", "",
+  "Get quantum."};
 
 void SetLaunchOffset(double offset)
 {
   g_launch_offset_reablink = offset;
 }
 
-const char* defstring_SetLaunchOffset =
-  "void\0double\0offset\0"
-  "Set launch offset. This is used to compensate for possible constant REAPER "
-  "transport launch delay, if such exists.";
+constexpr ApiDoc doc_SetLaunchOffset{
+  "Blink_SetLaunchOffset", "offset",
+  "Set launch offset, in seconds. REAPER transport start latency is measured "
+  "on each quantized launch; the offset is added to the measured latency to "
+  "trim the launch timing, if needed."};
+
+/*! @brief: Set timer tick intervals of the sync loop.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetTickIntervals(int fastMs, int normalMs, int idleMs)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setTickIntervals(
+    fastMs, normalMs, idleMs);
+}
+
+constexpr ApiDoc doc_SetTickIntervals{
+  "Blink_SetTickIntervals", "fastMs,normalMs,idleMs",
+  "Set timer tick intervals of the sync loop, in milliseconds. Fast ticks "
+  "are used during launches, tempo changes and loop wraps, idle ticks when "
+  "stopped or when playing without peers with Link locked to REAPER, normal "
+  "ticks otherwise. Defaults are 2, 12 and 40 ms; values below 1 are left "
+  "unchanged. Ticks are timed by a separate thread and run on the main "
+  "thread, so a busy main thread delays them."};
+
+/*! @brief: Measure REAPER transport start latency, record its output
+ *  latency compensation.
+ *  Thread-safe: no
+ *  Realtime-safe: no
+ */
+bool CalibrateLatency(int runs)
+{
+  auto& engine = LinkSession::getInstance().audioPlatform.mEngine;
+  if (runs < 0)
+  {
+    return false;
+  }
+  if (runs > 0)
+  {
+    return engine.startCalibration(runs);
+  }
+  engine.cancelCalibration();
+  engine.forgetCalibration();
+  return true;
+}
+
+constexpr ApiDoc doc_CalibrateLatency{
+  "Blink_CalibrateLatency", "runs",
+  "Start and stop REAPER transport the given number of times from the edit "
+  "cursor to measure transport start latency of the current audio device "
+  "against the Link clock. Output latency is not measured: it is recorded "
+  "as REAPER reports it, the compensation between its next-block and heard "
+  "play positions (GetPlayPosition2 minus GetPlayPosition), which includes "
+  "any manual output offset. It replaces GetOutputLatency in Blink host "
+  "times. Takes about 0.7 seconds per run with at most 32 runs, and "
+  "needs REAPER to be stopped. "
+  "Results are stored per audio device, sample rate and block size, and used "
+  "for launches and sync whenever that device is active. Zero runs cancels "
+  "and deletes the stored results of the current device, negative runs "
+  "return false."};
+
+/*! @brief: Get latency calibration of the current audio device.
+ *  Thread-safe: no
+ *  Realtime-safe: no
+ */
+bool GetLatencyCalibration(double* startLatencyOut, double* startJitterOut,
+                           double* outputLatencyOut, int* runsLeftOut)
+{
+  auto result = LatencyCalibration::Result{};
+  *runsLeftOut =
+    LinkSession::getInstance().audioPlatform.mEngine.getCalibration(&result);
+  *startLatencyOut = result.startLatency;
+  *startJitterOut = result.startJitter;
+  *outputLatencyOut = result.outputLatency;
+  return result.runs > 0;
+}
+
+constexpr ApiDoc doc_GetLatencyCalibration{
+  "Blink_GetLatencyCalibration",
+  "startLatencyOut,startJitterOut,outputLatencyOut,runsLeftOut",
+  "Get latency calibration of the current audio device, in seconds: median "
+  "transport start latency, half its spread and the output latency REAPER "
+  "compensates for, as reported by REAPER. Returns false "
+  "if the device has not been calibrated. Runs left is non-zero while a "
+  "calibration is running."};
 
 void SetMaster(bool enable)
 {
   LinkSession::getInstance().audioPlatform.mEngine.setMaster(enable);
 }
 
-const char* defstring_SetMaster =
-  "void\0bool\0enable\0"
-  "Set Blink as Master. Puppet needs to be "
-  "enabled first. Same as Puppet, but "
-  "possible beat offset is broadcast to Link "
-  "session, effectively forcing "
-  "local REAPER timeline on peers. Only one, if "
-  "any, Blink should be Master in "
-  "Link session.";
+constexpr ApiDoc doc_SetMaster{
+  "Blink_SetMaster", "enable",
+  "Set Blink as Master. Puppet needs to be enabled first. Same as Puppet, but "
+  "possible beat offset is broadcast to Link session, effectively forcing "
+  "local REAPER timeline on peers. Only one, if any, Blink should be Master in "
+  "Link session."};
 
 bool GetMaster()
 {
   return LinkSession::getInstance().audioPlatform.mEngine.getMaster();
 }
 
-const char* defstring_GetMaster = "bool\0\0\0"
-                                  "Is Blink Master?";
+constexpr ApiDoc doc_GetMaster{
+  "Blink_GetMaster", "",
+  "Is Blink Master?"};
 
 void SetPuppet(bool enable)
 {
   LinkSession::getInstance().audioPlatform.mEngine.setPuppet(enable);
 }
 
-const char* defstring_SetPuppet =
-  "void\0bool\0enable\0"
-  "Set Blink as Puppet. When enabled, Blink "
-  "attempts to synchronize local "
-  "REAPER tempo to Link session tempo by "
-  "adjusting current active tempo/time "
-  "signature marker, or broadcasts local REAPER "
-  "tempo changes into Link "
-  "session, and attempts to correct possible "
-  "offset by adjusting REAPER "
-  "playrate. Based on cumulative single beat "
-  "phase since Link session "
-  "transport start, regardless of quantum.";
+constexpr ApiDoc doc_SetPuppet{
+  "Blink_SetPuppet", "enable",
+  "Set Blink as Puppet. When enabled, Blink attempts to synchronize local "
+  "REAPER tempo to Link session tempo by adjusting current active tempo/time "
+  "signature marker, or broadcasts local REAPER tempo changes into Link "
+  "session, and attempts to correct possible offset by adjusting REAPER "
+  "playrate. Based on cumulative single beat phase since Link session "
+  "transport start, regardless of quantum."};
 
 bool GetPuppet()
 {
   return LinkSession::getInstance().audioPlatform.mEngine.getPuppet();
 }
 
-const char* defstring_GetPuppet = "bool\0\0\0"
-                                  "Is Blink Puppet?";
+constexpr ApiDoc doc_GetPuppet{
+  "Blink_GetPuppet", "",
+  "Is Blink Puppet?"};
+
+/*! @brief: Run sync loop on audio thread.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetRealtimeSync(bool enable)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setRealtime(enable);
+}
+
+constexpr ApiDoc doc_SetRealtimeSync{
+  "Blink_SetRealtimeSync", "enable",
+  "Run Blink Puppet/Master sync once per audio block in REAPER audio thread, "
+  "instead of main thread timer. Phase measurement and Link session capture "
+  "happen in audio thread, REAPER actions are deferred to main thread."};
+
+bool GetRealtimeSync()
+{
+  return LinkSession::getInstance().audioPlatform.mEngine.getRealtime();
+}
+
+constexpr ApiDoc doc_GetRealtimeSync{
+  "Blink_GetRealtimeSync", "",
+  "Is Blink sync run in audio thread?"};
+
+/*! @brief: Correct Puppet phase with a continuous playrate.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetPlayrateServo(bool enable, double bandwidth, double maxDeviation)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setPlayrateServo(
+    enable, bandwidth, maxDeviation);
+}
+
+constexpr ApiDoc doc_SetPlayrateServo{
+  "Blink_SetPlayrateServo", "enable,bandwidth,maxDeviation",
+  "Correct Blink Puppet phase by setting a continuous master playrate from a "
+  "PI controller, instead of stepping playrate by 10 cents. Bandwidth is the "
+  "loop natural frequency in Hz (default 0.5), higher converges faster but "
+  "follows measurement jitter. Playrate stays within 1 +/- maxDeviation "
+  "(default 0.02). Zero or negative values keep the current setting."};
+
+bool GetPlayrateServo(double* bandwidthOut, double* maxDeviationOut)
+{
+  return LinkSession::getInstance().audioPlatform.mEngine.getPlayrateServo(
+    bandwidthOut, maxDeviationOut);
+}
+
+constexpr ApiDoc doc_GetPlayrateServo{
+  "Blink_GetPlayrateServo", "bandwidthOut,maxDeviationOut",
+  "Is Blink Puppet playrate servo enabled? Gets its bandwidth in Hz and "
+  "playrate limit."};
+
+/*! @brief: Set how far ahead Master commits tempo map changes.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetTempoLookahead(double lookahead, double rampStep)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setTempoLookahead(
+    lookahead, rampStep);
+}
+
+constexpr ApiDoc doc_SetTempoLookahead{
+  "Blink_SetTempoLookahead", "lookahead,rampStep",
+  "Set how far ahead of playback Blink Master broadcasts REAPER tempo map "
+  "changes, in seconds (default 0.025, at most 1). Tempo markers within "
+  "lookahead are committed to Link session before they are reached. Linear "
+  "tempo ramps are committed as their average tempo over lookahead whenever "
+  "it moves by rampStep bpm (default 0.05). Keep lookahead above the timer "
+  "tick interval. Zero lookahead broadcasts the current tempo only, negative "
+  "values keep the current setting."};
+
+bool GetTempoLookahead(double* lookaheadOut, double* rampStepOut)
+{
+  *lookaheadOut =
+    LinkSession::getInstance().audioPlatform.mEngine.getTempoLookahead(
+      rampStepOut);
+  return *lookaheadOut > 0.;
+}
+
+constexpr ApiDoc doc_GetTempoLookahead{
+  "Blink_GetTempoLookahead", "lookaheadOut,rampStepOut",
+  "Does Blink Master broadcast tempo map changes ahead of playback? Gets the "
+  "lookahead in seconds and ramp step in bpm."};
+
+/*! @brief: Get audio clock drift against Link clock.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+double GetClockDriftPPM(bool* compensatedOut)
+{
+  return LinkSession::getInstance().audioPlatform.mEngine.getClockDrift(
+    compensatedOut);
+}
+
+constexpr ApiDoc doc_GetClockDriftPPM{
+  "Blink_GetClockDriftPPM", "compensatedOut",
+  "Get audio device clock drift against Link clock in parts per million, "
+  "positive when the audio clock runs fast. Estimated from audio block "
+  "timing over the last two minutes, 0 during the first 30 seconds after "
+  "the audio device starts or changes sample rate; dropouts keep it. Gets "
+  "whether Puppet playrate compensates it."};
+
+/*! @brief: Enable audio clock drift compensation.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetClockDriftCompensation(bool enable)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setClockDriftCompensation(
+    enable);
+}
+
+constexpr ApiDoc doc_SetClockDriftCompensation{
+  "Blink_SetClockDriftCompensation", "enable",
+  "Puppet playrate cancels the estimated audio device clock drift, so phase "
+  "corrections only handle what is left. Enabled by default."};
+
+/*! @brief: Enable click on Link beats in the audio device output.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetMetronome(bool enable, int channel, double volume)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setMetronome(
+    enable, channel, volume);
+}
+
+constexpr ApiDoc doc_SetMetronome{
+  "Blink_SetMetronome", "enable,channel,volume",
+  "Click on every Link session beat while Link session is playing, accented "
+  "on quantum boundaries. The click follows Link session timeline "
+  "sample-accurately instead of REAPER timeline, and is added to audio "
+  "device outputs channel and channel + 1, counting from 0. Volume is linear "
+  "(default 0.5). Negative channel or volume keeps the current setting."};
+
+bool GetMetronome(int* channelOut, double* volumeOut)
+{
+  return LinkSession::getInstance().audioPlatform.mEngine.getMetronome(
+    channelOut, volumeOut);
+}
+
+constexpr ApiDoc doc_GetMetronome{
+  "Blink_GetMetronome", "channelOut,volumeOut",
+  "Is Blink metronome enabled? Gets its first output channel and volume."};
+
+/*! @brief: Enable MIDI clock on Link session timeline.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void SetMidiClock(bool enable, int device)
+{
+  LinkSession::getInstance().audioPlatform.mEngine.setMidiClock(enable,
+                                                                device);
+}
+
+constexpr ApiDoc doc_SetMidiClock{
+  "Blink_SetMidiClock", "enable,device",
+  "Send 24 PPQN MIDI clock to REAPER MIDI output device, placed "
+  "sample-accurately on Link session timeline. When Link session starts "
+  "playing, Start is sent on song position zero, otherwise Song Position "
+  "Pointer and Continue on the next sixteenth note. Stop is sent when Link "
+  "session stops. Clock runs while stopped. Negative device keeps the current "
+  "setting."};
+
+bool GetMidiClock(int* deviceOut)
+{
+  return LinkSession::getInstance().audioPlatform.mEngine.getMidiClock(
+    deviceOut);
+}
+
+constexpr ApiDoc doc_GetMidiClock{
+  "Blink_GetMidiClock", "deviceOut",
+  "Is Blink MIDI clock enabled? Gets its MIDI output device."};
+
+/*! @brief: Get timing statistics of a sync loop phase.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+bool GetStats(const char* name, int* countOut, double* meanOut,
+              double* p50Out, double* p99Out, double* maxOut)
+{
+  using Stat = AudioEngine::Stat;
+  static const std::pair<const char*, Stat> stats[]{
+    {"interval", Stat::TickInterval}, {"tick", Stat::Tick},
+    {"capture", Stat::Capture},       {"timemap", Stat::TimeMap},
+    {"correction", Stat::Correction}, {"commit", Stat::Commit},
+    {"block", Stat::Block},
+    {"blockcorrection", Stat::BlockCorrection},
+  };
+  const auto it =
+    std::find_if(std::begin(stats), std::end(stats), [name](const auto& s) {
+      return name && strcmp(name, s.first) == 0;
+    });
+  if (it == std::end(stats))
+  {
+    return false;
+  }
+  const auto histogram =
+    LinkSession::getInstance().audioPlatform.mEngine.getStats(it->second);
+  // recorded in nanoseconds
+  *countOut = (int)histogram.count();
+  *meanOut = histogram.mean() / 1000.;
+  *p50Out = histogram.percentile(50.) / 1000.;
+  *p99Out = histogram.percentile(99.) / 1000.;
+  *maxOut = histogram.max() / 1000.;
+  return true;
+}
+
+constexpr ApiDoc doc_GetStats{
+  "Blink_GetStats", "name,countOut,meanOut,p50Out,p99Out,maxOut",
+  "Get timing statistics of Blink sync loop in microseconds. Name is one of "
+  "'interval' (time between timer ticks), 'tick' (whole timer tick), 'capture' "
+  "(Link session capture), 'timemap' (REAPER tempo map queries), 'correction' "
+  "(phase/playrate correction in a timer tick), 'commit' (Link session "
+  "commit), 'block' (real-time sync per audio block) or 'blockcorrection' "
+  "(phase/playrate correction in an audio block). Percentiles are accurate "
+  "to about 12%. "
+  "Returns false for unknown name."};
+
+/*! @brief: Clear sync loop timing statistics.
+ *  Thread-safe: yes
+ *  Realtime-safe: yes
+ */
+void ResetStats()
+{
+  LinkSession::getInstance().audioPlatform.mEngine.resetStats();
+}
+
+constexpr ApiDoc doc_ResetStats{
+  "Blink_ResetStats", "",
+  "Clear Blink sync loop timing statistics."};
+
+/*! @brief: Record sync loop steps to a trace file.
+ *  Thread-safe: no
+ *  Realtime-safe: no
+ */
+bool SetTraceFile(const char* path)
+{
+  return LinkSession::getInstance().audioPlatform.mEngine.setTraceFile(path);
+}
+
+constexpr ApiDoc doc_SetTraceFile{
+  "Blink_SetTraceFile", "path",
+  "Record inputs and decisions of every Blink sync loop step to a binary trace "
+  "file at path, replacing the file. The latest 262144 steps (about 45 minutes "
+  "in real-time sync) are kept. Empty path stops recording. Replay traces with "
+  "reablink_replay. Returns false if the file cannot be created."};
+
+// transport and tempo actions forwarded to Link, see
+// SetCaptureTransportCommands
+CommandTable g_commands;
+bool commandsHooked{false};
 
 bool runCommand(int command, int flag)
 {
   (void)flag;
-  auto res = false;
-  if (GetEnabled())
+  const auto action = g_commands.find(command);
+  if (!action || action->type == CommandAction::None || !GetEnabled())
   {
-    if (command == 40044)
-    {
-      res = true;
-      startStop();
-    }
-    if (command == 40073)
-    {
-      res = true;
-      startStop();
-    }
-    if (command == 1007)
-    {
-      res = true;
-      startStop();
-    }
-    if (command == 1008)
-    {
-      res = true;
-      startStop();
-    }
-    if (command == 1016)
-    {
-      res = true;
-      LinkSession::getInstance().audioPlatform.mEngine.stopPlaying();
-    }
-    if (command == 41130)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo - 1);
-    }
-    if (command == 41129)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo + 1);
-    }
-    if (command == 41135)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo + 10);
-    }
-    if (command == 41136)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo - 10);
-    }
-    if (command == 41134)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo / 2);
-    }
-    if (command == 41133)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo * 2);
-    }
-    if (command == 41131)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo * 1.1);
-    }
-    if (command == 41132)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo * 0.9);
-    }
-    if (command == 41137)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo + 0.1);
-    }
-    if (command == 41138)
-    {
-      res = true;
-      auto tempo = GetTempo();
-      LinkSession::getInstance().audioPlatform.mEngine.setTempo(tempo - 0.1);
-    }
+    return false;
   }
-  return res;
+
+  auto& engine = LinkSession::getInstance().audioPlatform.mEngine;
+  switch (action->type)
+  {
+  case CommandAction::StartStop:
+    startStop();
+    break;
+  case CommandAction::Play:
+    engine.startPlaying();
+    break;
+  case CommandAction::Stop:
+    engine.stopPlaying();
+    break;
+  case CommandAction::AddTempo:
+    engine.setTempo(GetTempo() + action->value);
+    break;
+  case CommandAction::ScaleTempo:
+    engine.setTempo(GetTempo() * action->value);
+    break;
+  case CommandAction::None:
+    return false;
+  }
+  return true;
 }
 
 void SetCaptureTransportCommands(bool enable)
 {
   if (enable)
   {
-    plugin_register("hookcommand", (void*)runCommand);
+    g_commands.reset();
+    const auto errors =
+      g_commands.parse(GetExtState("ak5k", "reablink_commands"),
+                       NamedCommandLookup);
+    if (errors > 0)
+    {
+      ShowConsoleMsg("ReaBlink: ignored invalid entries in ExtState "
+                     "ak5k/reablink_commands\n");
+    }
+    if (!commandsHooked)
+    {
+      plugin_register("hookcommand", (void*)runCommand);
+      commandsHooked = true;
+    }
   }
-  else
+  else if (commandsHooked)
   {
     plugin_register("-hookcommand", (void*)runCommand);
+    commandsHooked = false;
   }
 }
 
-const char* defstring_SetCaptureTransportCommands =
-  "void\0bool\0enable\0"
-  "Captures REAPER Transport commands and "
-  "'Tempo: Increase/Decrease current "
-  "project tempo by' commands and "
-  "broadcasts them into Link session. "
-  "When used with Master or Puppet mode "
-  "enabled, provides better integration "
-  "between REAPER and Link session transport "
-  "and tempos.";
+constexpr ApiDoc doc_SetCaptureTransportCommands{
+  "Blink_SetCaptureTransportCommands", "enable",
+  "Captures REAPER Transport commands and 'Tempo: Increase/Decrease current "
+  "project tempo by' commands and broadcasts them into Link session. When used "
+  "with Master or Puppet mode enabled, provides better integration between "
+  "REAPER and Link session transport and tempos. Additional mappings are read "
+  "from ExtState ak5k/reablink_commands when enabled, as "
+  "'command=action;...' where command is an action id or named command id and "
+  "action is startstop, play, stop, none, or tempo followed by +, -, * or / "
+  "and a number, e.g. '_SWS_BPMINC1=tempo+1'."};
 
 double Blink_GetVersion()
 {
@@ -729,204 +1317,83 @@ double Blink_GetVersion()
     std::string(std::to_string(major) + "." + std::to_string(minor)));
 }
 
-const char* defstring_Blink_GetVersion = "double\0\0\0"
-                                         "Get Blink version.";
+constexpr ApiDoc doc_Blink_GetVersion{
+  "Blink_GetVersion", "",
+  "Get Blink version."};
+
+// ReaScript API, registered in this order
+constexpr ApiFunction apiFunctions[]{
+  ApiFunction::of<&GetTimelineOffset, doc_GetTimelineOffset>(),
+  ApiFunction::of<&SetLaunchOffset, doc_SetLaunchOffset>(),
+  ApiFunction::of<&CalibrateLatency, doc_CalibrateLatency>(),
+  ApiFunction::of<&SetTickIntervals, doc_SetTickIntervals>(),
+  ApiFunction::of<&GetLatencyCalibration, doc_GetLatencyCalibration>(),
+  ApiFunction::of<&GetAudioBufferTimingInfo, doc_GetAudioBufferTimingInfo>(),
+  ApiFunction::of<&GetAudioBufferSampleTime, doc_GetAudioBufferSampleTime>(),
+  ApiFunction::of<&Blink_GetVersion, doc_Blink_GetVersion>(),
+  ApiFunction::of<&SetEnabled, doc_SetEnabled>(),
+  ApiFunction::of<&GetEnabled, doc_GetEnabled>(),
+  ApiFunction::of<&GetMaster, doc_GetMaster>(),
+  ApiFunction::of<&SetMaster, doc_SetMaster>(),
+  ApiFunction::of<&GetPuppet, doc_GetPuppet>(),
+  ApiFunction::of<&SetPuppet, doc_SetPuppet>(),
+  ApiFunction::of<&GetRealtimeSync, doc_GetRealtimeSync>(),
+  ApiFunction::of<&SetRealtimeSync, doc_SetRealtimeSync>(),
+  ApiFunction::of<&GetPlayrateServo, doc_GetPlayrateServo>(),
+  ApiFunction::of<&SetPlayrateServo, doc_SetPlayrateServo>(),
+  ApiFunction::of<&GetTempoLookahead, doc_GetTempoLookahead>(),
+  ApiFunction::of<&SetTempoLookahead, doc_SetTempoLookahead>(),
+  ApiFunction::of<&GetClockDriftPPM, doc_GetClockDriftPPM>(),
+  ApiFunction::of<&SetClockDriftCompensation,
+                  doc_SetClockDriftCompensation>(),
+  ApiFunction::of<&GetMetronome, doc_GetMetronome>(),
+  ApiFunction::of<&SetMetronome, doc_SetMetronome>(),
+  ApiFunction::of<&GetMidiClock, doc_GetMidiClock>(),
+  ApiFunction::of<&SetMidiClock, doc_SetMidiClock>(),
+  ApiFunction::of<&GetBeatsAtTimes, doc_GetBeatsAtTimes>(),
+  ApiFunction::of<&GetPhasesAtTimes, doc_GetPhasesAtTimes>(),
+  ApiFunction::of<&GetTimesAtBeats, doc_GetTimesAtBeats>(),
+  ApiFunction::of<&GetSessionSnapshot, doc_GetSessionSnapshot>(),
+  ApiFunction::of<&PollEvents, doc_PollEvents>(),
+  ApiFunction::of<&GetStats, doc_GetStats>(),
+  ApiFunction::of<&ResetStats, doc_ResetStats>(),
+  ApiFunction::of<&SetTraceFile, doc_SetTraceFile>(),
+  ApiFunction::of<&GetStartStopSyncEnabled, doc_GetStartStopSyncEnabled>(),
+  ApiFunction::of<&SetStartStopSyncEnabled, doc_SetStartStopSyncEnabled>(),
+  ApiFunction::of<&GetNumPeers, doc_GetNumPeers>(),
+  ApiFunction::of<&GetClockNow, doc_GetClockNow>(),
+  ApiFunction::of<&GetTempo, doc_GetTempo>(),
+  ApiFunction::of<&GetBeatAtTime, doc_GetBeatAtTime>(),
+  ApiFunction::of<&GetPhaseAtTime, doc_GetPhaseAtTime>(),
+  ApiFunction::of<&GetTimeAtBeat, doc_GetTimeAtBeat>(),
+  ApiFunction::of<&GetTimeForPlaying, doc_GetTimeForPlaying>(),
+  ApiFunction::of<&GetPlaying, doc_GetPlaying>(),
+  ApiFunction::of<&SetPlaying, doc_SetPlaying>(),
+  ApiFunction::of<&startStop, doc_startStop>(),
+  ApiFunction::of<&SetTempo, doc_SetTempo>(),
+  ApiFunction::of<&SetTempoAtTime, doc_SetTempoAtTime>(),
+  ApiFunction::of<&SetBeatAtTimeRequest, doc_SetBeatAtTimeRequest>(),
+  ApiFunction::of<&SetQuantum, doc_SetQuantum>(),
+  ApiFunction::of<&GetQuantum, doc_GetQuantum>(),
+  ApiFunction::of<&SetBeatAtTimeForce, doc_SetBeatAtTimeForce>(),
+  ApiFunction::of<&SetPlayingAndBeatAtTimeRequest,
+                  doc_SetPlayingAndBeatAtTimeRequest>(),
+  ApiFunction::of<&SetBeatAtStartPlayingTimeRequest,
+                  doc_SetBeatAtStartPlayingTimeRequest>(),
+  ApiFunction::of<&SetCaptureTransportCommands,
+                  doc_SetCaptureTransportCommands>(),
+};
 
 void Init(void* ptr)
 {
   auto rec = (reaper_plugin_info_t*)ptr;
 
-  plugin_register("API_Blink_GetTimelineOffset", (void*)GetTimelineOffset);
-  plugin_register("APIdef_Blink_GetTimelineOffset",
-                  (void*)defstring_GetTimelineOffset);
-  plugin_register(
-    "APIvararg_Blink_GetTimelineOffset",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetTimelineOffset>));
-
-  plugin_register("API_Blink_SetLaunchOffset", (void*)SetLaunchOffset);
-  plugin_register("APIdef_Blink_SetLaunchOffset",
-                  (void*)defstring_SetLaunchOffset);
-  plugin_register(
-    "APIvararg_Blink_SetLaunchOffset",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetLaunchOffset>));
-
-  plugin_register("API_Blink_GetAudioBufferTimingInfo",
-                  (void*)GetAudioBufferTimingInfo);
-  plugin_register("APIdef_Blink_GetAudioBufferTimingInfo",
-                  (void*)defstring_GetAudioBufferTimingInfo);
-  plugin_register(
-    "APIvararg_Blink_GetAudioBufferTimingInfo",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetAudioBufferTimingInfo>));
-
-  plugin_register("API_Blink_GetVersion", (void*)Blink_GetVersion);
-  plugin_register("APIdef_Blink_GetVersion", (void*)defstring_Blink_GetVersion);
-  plugin_register(
-    "APIvararg_Blink_GetVersion",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&Blink_GetVersion>));
-
-  plugin_register("API_Blink_SetEnabled", (void*)SetEnabled);
-  plugin_register("APIdef_Blink_SetEnabled", (void*)defstring_SetEnabled);
-  plugin_register("APIvararg_Blink_SetEnabled",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetEnabled>));
-
-  plugin_register("API_Blink_GetEnabled", (void*)GetEnabled);
-  plugin_register("APIdef_Blink_GetEnabled", (void*)defstring_GetEnabled);
-  plugin_register("APIvararg_Blink_GetEnabled",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetEnabled>));
-
-  plugin_register("API_Blink_GetMaster", (void*)GetMaster);
-  plugin_register("APIdef_Blink_GetMaster", (void*)defstring_GetMaster);
-  plugin_register("APIvararg_Blink_GetMaster",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetMaster>));
-
-  plugin_register("API_Blink_SetMaster", (void*)SetMaster);
-  plugin_register("APIdef_Blink_SetMaster", (void*)defstring_SetMaster);
-  plugin_register("APIvararg_Blink_SetMaster",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetMaster>));
-
-  plugin_register("API_Blink_GetPuppet", (void*)GetPuppet);
-  plugin_register("APIdef_Blink_GetPuppet", (void*)defstring_GetPuppet);
-  plugin_register("APIvararg_Blink_GetPuppet",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetPuppet>));
-
-  plugin_register("API_Blink_SetPuppet", (void*)SetPuppet);
-  plugin_register("APIdef_Blink_SetPuppet", (void*)defstring_SetPuppet);
-  plugin_register("APIvararg_Blink_SetPuppet",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetPuppet>));
-
-  plugin_register("API_Blink_GetStartStopSyncEnabled",
-                  (void*)GetStartStopSyncEnabled);
-  plugin_register("APIdef_Blink_GetStartStopSyncEnabled",
-                  (void*)defstring_GetStartStopSyncEnabled);
-  plugin_register(
-    "APIvararg_Blink_GetStartStopSyncEnabled",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetStartStopSyncEnabled>));
-
-  plugin_register("API_Blink_SetStartStopSyncEnabled",
-                  (void*)SetStartStopSyncEnabled);
-  plugin_register("APIdef_Blink_SetStartStopSyncEnabled",
-                  (void*)defstring_SetStartStopSyncEnabled);
-  plugin_register(
-    "APIvararg_Blink_SetStartStopSyncEnabled",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetStartStopSyncEnabled>));
-
-  plugin_register("API_Blink_GetNumPeers", (void*)GetNumPeers);
-  plugin_register("APIdef_Blink_GetNumPeers", (void*)defstring_GetNumPeers);
-  plugin_register("APIvararg_Blink_GetNumPeers",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetNumPeers>));
-
-  plugin_register("API_Blink_GetClockNow", (void*)GetClockNow);
-  plugin_register("APIdef_Blink_GetClockNow", (void*)defstring_GetClockNow);
-  plugin_register("APIvararg_Blink_GetClockNow",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetClockNow>));
-
-  plugin_register("API_Blink_GetTempo", (void*)GetTempo);
-  plugin_register("APIdef_Blink_GetTempo", (void*)defstring_GetTempo);
-  plugin_register("APIvararg_Blink_GetTempo",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetTempo>));
-
-  plugin_register("API_Blink_GetBeatAtTime", (void*)GetBeatAtTime);
-  plugin_register("APIdef_Blink_GetBeatAtTime", (void*)defstring_GetBeatAtTime);
-  plugin_register("APIvararg_Blink_GetBeatAtTime",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetBeatAtTime>));
-
-  plugin_register("API_Blink_GetPhaseAtTime", (void*)GetPhaseAtTime);
-  plugin_register("APIdef_Blink_GetPhaseAtTime",
-                  (void*)defstring_GetPhaseAtTime);
-  plugin_register(
-    "APIvararg_Blink_GetPhaseAtTime",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetPhaseAtTime>));
-
-  plugin_register("API_Blink_GetTimeAtBeat", (void*)GetTimeAtBeat);
-  plugin_register("APIdef_Blink_GetTimeAtBeat", (void*)defstring_GetTimeAtBeat);
-  plugin_register("APIvararg_Blink_GetTimeAtBeat",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetTimeAtBeat>));
-
-  plugin_register("API_Blink_GetTimeForPlaying", (void*)GetTimeForPlaying);
-  plugin_register("APIdef_Blink_GetTimeForPlaying",
-                  (void*)defstring_GetTimeForPlaying);
-  plugin_register(
-    "APIvararg_Blink_GetTimeForPlaying",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetTimeForPlaying>));
-
-  plugin_register("API_Blink_GetPlaying", (void*)GetPlaying);
-  plugin_register("APIdef_Blink_GetPlaying", (void*)defstring_GetPlaying);
-  plugin_register("APIvararg_Blink_GetPlaying",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetPlaying>));
-
-  plugin_register("API_Blink_SetPlaying", (void*)SetPlaying);
-  plugin_register("APIdef_Blink_SetPlaying", (void*)defstring_SetPlaying);
-  plugin_register("APIvararg_Blink_SetPlaying",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetPlaying>));
-
-  plugin_register("API_Blink_StartStop", (void*)startStop);
-  plugin_register("APIdef_Blink_StartStop", (void*)defstring_startStop);
-  plugin_register("APIvararg_Blink_StartStop",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&startStop>));
-
-  plugin_register("API_Blink_SetTempo", (void*)SetTempo);
-  plugin_register("APIdef_Blink_SetTempo", (void*)defstring_SetTempo);
-  plugin_register("APIvararg_Blink_SetTempo",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetTempo>));
-
-  plugin_register("API_Blink_SetTempoAtTime", (void*)SetTempoAtTime);
-  plugin_register("APIdef_Blink_SetTempoAtTime",
-                  (void*)defstring_SetTempoAtTime);
-  plugin_register(
-    "APIvararg_Blink_SetTempoAtTime",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetTempoAtTime>));
-
-  plugin_register("API_Blink_SetBeatAtTimeRequest",
-                  (void*)SetBeatAtTimeRequest);
-  plugin_register("APIdef_Blink_SetBeatAtTimeRequest",
-                  (void*)defstring_SetBeatAtTimeRequest);
-  plugin_register(
-    "APIvararg_Blink_SetBeatAtTimeRequest",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetBeatAtTimeRequest>));
-
-  plugin_register("API_Blink_SetQuantum", (void*)SetQuantum);
-  plugin_register("APIdef_Blink_SetQuantum", (void*)defstring_SetQuantum);
-  plugin_register("APIvararg_Blink_SetQuantum",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetQuantum>));
-
-  plugin_register("API_Blink_GetQuantum", (void*)GetQuantum);
-  plugin_register("APIdef_Blink_GetQuantum", (void*)defstring_GetQuantum);
-  plugin_register("APIvararg_Blink_GetQuantum",
-                  reinterpret_cast<void*>(&InvokeReaScriptAPI<&GetQuantum>));
-
-  plugin_register("API_Blink_SetBeatAtTimeForce", (void*)SetBeatAtTimeForce);
-  plugin_register("APIdef_Blink_SetBeatAtTimeForce",
-                  (void*)defstring_SetBeatAtTimeForce);
-  plugin_register(
-    "APIvararg_Blink_SetBeatAtTimeForce",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetBeatAtTimeForce>));
-
-  plugin_register("API_Blink_SetPlayingAndBeatAtTimeRequest",
-                  (void*)SetPlayingAndBeatAtTimeRequest);
-  plugin_register("APIdef_Blink_SetPlayingAndBeatAtTimeRequest",
-                  (void*)defstring_SetPlayingAndBeatAtTimeRequest);
-  plugin_register("APIvararg_Blink_"
-                  "SetPlayingAndBeatAtTimeRequest",
-                  reinterpret_cast<void*>(
-                    &InvokeReaScriptAPI<&SetPlayingAndBeatAtTimeRequest>));
-
-  plugin_register("API_Blink_SetBeatAtStartPlayingTimeRequest",
-                  (void*)SetBeatAtStartPlayingTimeRequest);
-  plugin_register("APIdef_Blink_"
-                  "SetBeatAtStartPlayingTimeRequest",
-                  (void*)defstring_SetBeatAtStartPlayingTimeRequest);
-  plugin_register("APIvararg_Blink_"
-                  "SetBeatAtStartPlayingTimeRequest",
-                  reinterpret_cast<void*>(
-                    &InvokeReaScriptAPI<&SetBeatAtStartPlayingTimeRequest>));
-
-  plugin_register("API_Blink_SetCaptureTransportCommands",
-                  (void*)SetCaptureTransportCommands);
-  plugin_register("APIdef_Blink_SetCaptureTransportCommands",
-                  (void*)defstring_SetCaptureTransportCommands);
-  plugin_register(
-    "APIvararg_Blink_SetCaptureTransportCommands",
-    reinterpret_cast<void*>(&InvokeReaScriptAPI<&SetCaptureTransportCommands>));
+  for (const auto& function : apiFunctions)
+  {
+    function.apply(true);
+  }
+  mainWindow = rec->hwnd_main;
+  tickCommand = plugin_register("command_id", (void*)"REABLINK_SYNC_TICK");
 
   std::string init = GetExtState("ak5k", "reablink_init");
   if (init.empty())
@@ -958,7 +1425,21 @@ void Init(void* ptr)
       AddRemoveReaScript(false, 0, path.c_str(), false);
     }
   }
+}
 
-  (void)rec;
+// Scripts register the sync tick, audio hook and command hook after Init,
+// undo everything in reverse order of registration.
+void Unregister()
+{
+  SetCaptureTransportCommands(false);
+  if (tickThread.running())
+  {
+    SetEnabled(false);
+  }
+  for (auto function = std::rbegin(apiFunctions);
+       function != std::rend(apiFunctions); ++function)
+  {
+    function->apply(false);
+  }
 }
 } // namespace reablink
\ No newline at end of file
@@ -4,7 +4,7 @@
 namespace reablink
 {
 void Init(void* rec);
-// void Unregister();
+void Unregister();
 } // namespace reablink
 
 #endif // API_HPP
@@ -0,0 +1,235 @@
+#include "calibration.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+#include <reaper_plugin_functions.h>
+
+namespace reablink
+{
+namespace
+{
+constexpr auto extStateSection = "ak5k";
+constexpr auto settleTime = 0.2; // stopped, between runs, seconds
+constexpr auto runTime = 0.5;    // playing, per run, seconds
+constexpr auto launchSuffix = "_launch";
+constexpr auto maxRuns = 32; // about 20 seconds
+
+double seconds(std::chrono::microseconds time)
+{
+  return time.count() / 1.0e6;
+}
+
+double median(std::vector<double> values)
+{
+  const auto middle = values.begin() + values.size() / 2;
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+} // namespace
+
+bool LatencyCalibration::start(int runs, double position)
+{
+  if (runs < 1 || (GetPlayState() & 1))
+  {
+    return false;
+  }
+  mPhase = Phase::Starting;
+  mRunsLeft = std::min(runs, maxRuns);
+  mPosition = position;
+  mPhaseTime = std::chrono::microseconds{0};
+  mStartLatencies.clear();
+  mOutputLatencies.clear();
+  mStartLatencies.reserve(mRunsLeft);
+  return true;
+}
+
+void LatencyCalibration::cancel()
+{
+  if (mPhase == Phase::Playing)
+  {
+    OnStopButton();
+  }
+  mPhase = Phase::Idle;
+  mRunsLeft = 0;
+}
+
+bool LatencyCalibration::running() const
+{
+  return mPhase != Phase::Idle;
+}
+
+int LatencyCalibration::runsLeft() const
+{
+  return mRunsLeft;
+}
+
+bool LatencyCalibration::tick(std::chrono::microseconds hostTime)
+{
+  if (mPhaseTime.count() == 0)
+  {
+    mPhaseTime = hostTime;
+  }
+  const auto elapsed = seconds(hostTime - mPhaseTime);
+
+  switch (mPhase)
+  {
+  case Phase::Idle:
+    return false;
+
+  case Phase::Starting:
+    if (elapsed < settleTime)
+    {
+      return false;
+    }
+    SetEditCurPos(mPosition, false, false);
+    OnPlayButton();
+    mPhase = Phase::Playing;
+    mPhaseTime = hostTime;
+    mStartMeasured = false;
+    return false;
+
+  case Phase::Playing:
+    if (GetPlayState() & 1)
+    {
+      // REAPER position of the next block, heard at hostTime
+      const auto played = GetPlayPosition2() - mPosition;
+      if (!mStartMeasured && played > 0.)
+      {
+        mStartLatencies.push_back(elapsed - played);
+        mStartMeasured = true;
+      }
+      // REAPER's latency compensation, as it reports it
+      if (mStartMeasured && Master_GetPlayRate(0) == 1.)
+      {
+        mOutputLatencies.push_back(GetPlayPosition2() - GetPlayPosition());
+      }
+    }
+    // a run that never started counts as done too
+    if (elapsed < runTime)
+    {
+      return false;
+    }
+    OnStopButton();
+    SetEditCurPos(mPosition, false, false);
+    mPhaseTime = hostTime;
+    if (--mRunsLeft > 0)
+    {
+      mPhase = Phase::Starting;
+      return false;
+    }
+    finish();
+    return true;
+  }
+  return false;
+}
+
+void LatencyCalibration::finish()
+{
+  mPhase = Phase::Idle;
+  if (mStartLatencies.empty() || mOutputLatencies.empty())
+  {
+    return;
+  }
+
+  const auto [lowest, highest] =
+    std::minmax_element(mStartLatencies.begin(), mStartLatencies.end());
+  mResult.startLatency = median(mStartLatencies);
+  mResult.startJitter = (*highest - *lowest) / 2.;
+  mResult.outputLatency = median(mOutputLatencies);
+  mResult.runs = (int)mStartLatencies.size();
+  mValid = true;
+
+  char value[128];
+  snprintf(value, sizeof(value), "%.6f %.6f %.6f %d", mResult.startLatency,
+           mResult.startJitter, mResult.outputLatency, mResult.runs);
+  SetExtState(extStateSection, mDevice.c_str(), value, true);
+}
+
+std::string LatencyCalibration::deviceKey()
+{
+  auto key = std::string("reablink_latency");
+  for (const auto* name : {"IDENT_OUT", "SRATE", "BSIZE"})
+  {
+    char value[256]{};
+    GetAudioDeviceInfo(name, value, (int)sizeof(value));
+    key += '_';
+    key += value;
+  }
+  // ExtState is an ini file
+  std::replace_if(
+    key.begin(), key.end(),
+    [](unsigned char c) { return !std::isalnum(c) && c != '_' && c != '.'; },
+    '_');
+  return key;
+}
+
+bool LatencyCalibration::update()
+{
+  // device changes are rare, poll once per second
+  const auto now = time_precise();
+  if (!mDevice.empty() && now - mLastUpdate < 1.)
+  {
+    return false;
+  }
+  mLastUpdate = now;
+
+  auto device = deviceKey();
+  if (device == mDevice)
+  {
+    return false;
+  }
+  mDevice = std::move(device);
+  mValid = false;
+  const auto* value = GetExtState(extStateSection, mDevice.c_str());
+  if (value && *value)
+  {
+    auto result = Result{};
+    mValid = sscanf(value, "%lf %lf %lf %d", &result.startLatency,
+                    &result.startJitter, &result.outputLatency,
+                    &result.runs) == 4;
+    mResult = result;
+  }
+  mLaunchLatency = -1.;
+  value = GetExtState(extStateSection, (mDevice + launchSuffix).c_str());
+  if (value && *value)
+  {
+    mLaunchLatency = atof(value);
+  }
+  return true;
+}
+
+void LatencyCalibration::forget()
+{
+  if (!mDevice.empty())
+  {
+    DeleteExtState(extStateSection, mDevice.c_str(), true);
+    DeleteExtState(extStateSection, (mDevice + launchSuffix).c_str(), true);
+  }
+  mValid = false;
+  mLaunchLatency = -1.;
+}
+
+const LatencyCalibration::Result* LatencyCalibration::result() const
+{
+  return mValid ? &mResult : nullptr;
+}
+
+double LatencyCalibration::launchLatency() const
+{
+  return mLaunchLatency;
+}
+
+void LatencyCalibration::storeLaunchLatency(double latency)
+{
+  mLaunchLatency = std::max(0., latency);
+  if (mDevice.empty())
+  {
+    return;
+  }
+  char value[32];
+  snprintf(value, sizeof(value), "%.6f", mLaunchLatency);
+  SetExtState(extStateSection, (mDevice + launchSuffix).c_str(), value, true);
+}
+} // namespace reablink
@@ -0,0 +1,76 @@
+#ifndef REABLINK_CALIBRATION_HPP
+#define REABLINK_CALIBRATION_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace reablink
+{
+// Measures REAPER transport start latency of the current audio device by
+// starting and stopping the transport a number of times, and records the
+// output latency REAPER compensates for while it plays. That one is
+// REAPER's own figure, not measured against the Link clock.
+// Results are stored in ExtState per device, sample rate and block size, and
+// loaded again when that device comes back. The start latency measured
+// by quantized launches is kept the same way, for devices that were not
+// calibrated. Host times are those of AudioEngine::audioCallback. Main
+// thread only.
+class LatencyCalibration
+{
+public:
+  struct Result
+  {
+    double startLatency;  // median, from starting REAPER to hearing it
+    double startJitter;   // half the spread of measured start latencies
+    double outputLatency; // median GetPlayPosition2 - GetPlayPosition
+    int runs;
+  };
+
+  // starts from position, false if REAPER is playing or runs < 1. Runs
+  // are limited to 32.
+  bool start(int runs, double position);
+  void cancel();
+  bool running() const;
+  int runsLeft() const;
+  // advances a running calibration, true when it finished on this tick
+  bool tick(std::chrono::microseconds hostTime);
+
+  // reloads results if the audio device changed, true if it did
+  bool update();
+  // deletes stored results of the current device
+  void forget();
+  // nullptr if the current device has not been calibrated
+  const Result* result() const;
+  // start latency of recent launches on the current device, < 0 if none
+  double launchLatency() const;
+  void storeLaunchLatency(double latency);
+
+private:
+  enum class Phase
+  {
+    Idle,
+    Starting,
+    Playing,
+  };
+
+  static std::string deviceKey();
+  void finish();
+
+  Phase mPhase{Phase::Idle};
+  int mRunsLeft{0};
+  double mPosition{0.};
+  std::chrono::microseconds mPhaseTime{0};
+  bool mStartMeasured{false};
+  std::vector<double> mStartLatencies;
+  std::vector<double> mOutputLatencies;
+
+  std::string mDevice;
+  double mLastUpdate{0.};
+  Result mResult{};
+  bool mValid{false};
+  double mLaunchLatency{-1.};
+};
+} // namespace reablink
+
+#endif // REABLINK_CALIBRATION_HPP
@@ -0,0 +1,226 @@
+#include "command_table.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace reablink
+{
+namespace
+{
+struct DefaultCommand
+{
+  int command;
+  CommandAction action;
+};
+
+// REAPER transport and "Tempo: Increase/Decrease current project tempo"
+constexpr DefaultCommand defaultCommands[]{
+  {40044, {CommandAction::StartStop, 0.}}, // Transport: Play/stop
+  {40073, {CommandAction::StartStop, 0.}}, // Transport: Play/pause
+  {1007, {CommandAction::StartStop, 0.}},  // Transport: Play
+  {1008, {CommandAction::StartStop, 0.}},  // Transport: Pause
+  {1016, {CommandAction::Stop, 0.}},       // Transport: Stop
+  {41129, {CommandAction::AddTempo, 1.}},
+  {41130, {CommandAction::AddTempo, -1.}},
+  {41135, {CommandAction::AddTempo, 10.}},
+  {41136, {CommandAction::AddTempo, -10.}},
+  {41137, {CommandAction::AddTempo, 0.1}},
+  {41138, {CommandAction::AddTempo, -0.1}},
+  {41131, {CommandAction::ScaleTempo, 1.1}},
+  {41132, {CommandAction::ScaleTempo, 0.9}},
+  {41133, {CommandAction::ScaleTempo, 2.}},
+  {41134, {CommandAction::ScaleTempo, 0.5}},
+};
+
+bool parseAction(const std::string& text, CommandAction* action)
+{
+  if (text == "startstop")
+  {
+    *action = {CommandAction::StartStop, 0.};
+    return true;
+  }
+  if (text == "play")
+  {
+    *action = {CommandAction::Play, 0.};
+    return true;
+  }
+  if (text == "stop")
+  {
+    *action = {CommandAction::Stop, 0.};
+    return true;
+  }
+  if (text == "none")
+  {
+    *action = {CommandAction::None, 0.};
+    return true;
+  }
+  if (text.size() < 7 || text.compare(0, 5, "tempo") != 0)
+  {
+    return false;
+  }
+
+  const auto op = text[5];
+  const auto number = text.c_str() + 6;
+  char* end = nullptr;
+  const auto value = std::strtod(number, &end);
+  if (end == number || *end != '\0' || !(value > 0.))
+  {
+    return false;
+  }
+  switch (op)
+  {
+  case '+':
+    *action = {CommandAction::AddTempo, value};
+    return true;
+  case '-':
+    *action = {CommandAction::AddTempo, -value};
+    return true;
+  case '*':
+    *action = {CommandAction::ScaleTempo, value};
+    return true;
+  case '/':
+    *action = {CommandAction::ScaleTempo, 1. / value};
+    return true;
+  default:
+    return false;
+  }
+}
+
+std::string trim(const std::string& text)
+{
+  const auto first = text.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos)
+  {
+    return std::string();
+  }
+  const auto last = text.find_last_not_of(" \t\r\n");
+  return text.substr(first, last - first + 1);
+}
+} // namespace
+
+CommandTable::CommandTable()
+{
+  reset();
+}
+
+void CommandTable::reset()
+{
+  mSlots.fill(Slot{0, {CommandAction::None, 0.}});
+  mSize = 0;
+  for (const auto& entry : defaultCommands)
+  {
+    set(entry.command, entry.action);
+  }
+}
+
+std::size_t CommandTable::slotOf(int command)
+{
+  // Fibonacci hashing, top bits of the product
+  return (std::size_t)(((std::uint32_t)command * 2654435769u) >> 24) &
+         (capacity - 1);
+}
+
+bool CommandTable::set(int command, CommandAction action)
+{
+  if (command == 0)
+  {
+    return false;
+  }
+  for (auto i = slotOf(command);; i = (i + 1) & (capacity - 1))
+  {
+    auto& slot = mSlots[i];
+    if (slot.command == command)
+    {
+      slot.action = action;
+      return true;
+    }
+    if (slot.command == 0)
+    {
+      // at most half full, probe sequences stay short
+      if (mSize >= capacity / 2)
+      {
+        return false;
+      }
+      slot = Slot{command, action};
+      ++mSize;
+      return true;
+    }
+  }
+}
+
+const CommandAction* CommandTable::find(int command) const
+{
+  for (auto i = slotOf(command);; i = (i + 1) & (capacity - 1))
+  {
+    const auto& slot = mSlots[i];
+    if (slot.command == command)
+    {
+      return command == 0 ? nullptr : &slot.action;
+    }
+    if (slot.command == 0)
+    {
+      return nullptr;
+    }
+  }
+}
+
+std::size_t CommandTable::size() const
+{
+  return mSize;
+}
+
+int CommandTable::parse(const char* mappings, int (*lookup)(const char*))
+{
+  auto errors = 0;
+  if (!mappings)
+  {
+    return errors;
+  }
+  const auto text = std::string(mappings);
+  std::size_t pos = 0;
+  while (pos <= text.size())
+  {
+    auto next = text.find(';', pos);
+    if (next == std::string::npos)
+    {
+      next = text.size();
+    }
+    const auto entry = trim(text.substr(pos, next - pos));
+    pos = next + 1;
+    if (entry.empty())
+    {
+      continue;
+    }
+
+    const auto eq = entry.find('=');
+    if (eq == std::string::npos)
+    {
+      ++errors;
+      continue;
+    }
+    const auto name = trim(entry.substr(0, eq));
+    auto command = 0;
+    if (!name.empty() && name[0] == '_')
+    {
+      command = lookup ? lookup(name.c_str()) : 0;
+    }
+    else
+    {
+      char* end = nullptr;
+      command = (int)std::strtol(name.c_str(), &end, 10);
+      if (name.empty() || *end != '\0')
+      {
+        command = 0;
+      }
+    }
+
+    auto action = CommandAction{CommandAction::None, 0.};
+    if (command == 0 || !parseAction(trim(entry.substr(eq + 1)), &action) ||
+        !set(command, action))
+    {
+      ++errors;
+    }
+  }
+  return errors;
+}
+} // namespace reablink
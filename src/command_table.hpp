@@ -0,0 +1,65 @@
+#ifndef REABLINK_COMMAND_TABLE_HPP
+#define REABLINK_COMMAND_TABLE_HPP
+
+#include <array>
+#include <cstddef>
+
+namespace reablink
+{
+// What a captured REAPER action does to the Link session.
+struct CommandAction
+{
+  enum Type
+  {
+    None, // mapped but passed through, disables a default
+    StartStop,
+    Play,
+    Stop,
+    AddTempo,   // tempo + value
+    ScaleTempo, // tempo * value
+  };
+
+  Type type;
+  double value;
+};
+
+// Command id to action map for the hookcommand handler. Open addressing
+// with a multiplicative hash, so actions that are not mapped cost one probe
+// of an empty slot. Starts with REAPER's transport and tempo actions;
+// user mappings are added with parse(). Main thread only.
+class CommandTable
+{
+public:
+  CommandTable();
+
+  // back to the default mappings
+  void reset();
+  // adds or replaces, false if the table is full or command is 0
+  bool set(int command, CommandAction action);
+  // nullptr if command is not mapped
+  const CommandAction* find(int command) const;
+  std::size_t size() const;
+
+  // Adds mappings from "command=action;command=action". Command is a
+  // numeric id or a named command id such as "_SWS_BPMINC1", resolved with
+  // lookup. Action is one of startstop, play, stop, none, or tempo followed
+  // by +, -, * or / and a number, e.g. "tempo+0.5". Returns the number of
+  // entries that were not understood; the rest are applied.
+  int parse(const char* mappings, int (*lookup)(const char*));
+
+private:
+  struct Slot
+  {
+    int command; // 0 is empty, REAPER does not use it
+    CommandAction action;
+  };
+
+  static constexpr std::size_t capacity = 256; // power of two
+  static std::size_t slotOf(int command);
+
+  std::array<Slot, capacity> mSlots{};
+  std::size_t mSize{0};
+};
+} // namespace reablink
+
+#endif // REABLINK_COMMAND_TABLE_HPP
@@ -7,9 +7,10 @@
 #include "RollingAverage.hpp"
 #include "global_vars.hpp"
 #include <algorithm>
+#include <cmath>
 #include <deque>
+#include <limits>
 #include <numeric>
-#include <vector>
 
 #include <reaper_plugin_functions.h>
 
@@ -18,11 +19,10 @@ namespace reablink
 using namespace ableton;
 
 constexpr int TIMER_INTERVALS_SIZE = 512;
+constexpr double PLAYRATE_STEP = 1.0057929410678534; // 40524/40525, 10 cents
 
 AudioEngine::AudioEngine(Link& link)
     : mLink(link)
-    , mSharedEngineData({0., false, false, 4., false})
-    , mLockfreeEngineData(mSharedEngineData)
     , mIsPlaying(false)
 {
 }
@@ -47,16 +47,220 @@ bool AudioEngine::getPuppet()
     return this->isPuppet;
 }
 
+// takes effect on the next timer tick, see handOverSync
+void AudioEngine::setRealtime(bool isRealtime)
+{
+    this->isRealtime = isRealtime;
+}
+
+bool AudioEngine::getRealtime() const
+{
+    return this->isRealtime;
+}
+
+void AudioEngine::setPlayrateServo(
+    bool enabled, double bandwidth, double maxDeviation
+)
+{
+    if (bandwidth > 0.)
+        mServoBandwidth = bandwidth;
+    if (maxDeviation > 0.)
+        mServoMaxDeviation = std::min(maxDeviation, 0.5);
+    mServo = enabled;
+}
+
+void AudioEngine::setClockDriftCompensation(bool enabled)
+{
+    mDriftCompensation = enabled;
+}
+
+double AudioEngine::getClockDrift(bool* compensated) const
+{
+    if (compensated)
+        *compensated = mDriftCompensation;
+    return mClockDrift;
+}
+
+void AudioEngine::updateClockDrift(
+    const bool reset,
+    const double sampleTime,
+    const double hostTime,
+    const double srate
+)
+{
+    // the drift outlives dropouts, only a new sample rate starts over
+    if (reset && 1.0e6 / srate == mDriftEstimator.nominalPeriod())
+        mDriftEstimator.reanchor(sampleTime);
+    else if (reset)
+        mDriftEstimator.reset(1.0e6 / srate);
+    mDriftEstimator.update(sampleTime, hostTime);
+    mClockDrift = mDriftEstimator.ppm();
+}
+
+bool AudioEngine::getPlayrateServo(double* bandwidth, double* maxDeviation)
+    const
+{
+    if (bandwidth)
+        *bandwidth = mServoBandwidth;
+    if (maxDeviation)
+        *maxDeviation = mServoMaxDeviation;
+    return mServo;
+}
+
+void AudioEngine::setTempoLookahead(double lookahead, double rampStep)
+{
+    if (lookahead >= 0.)
+        mTempoLookahead = std::min(lookahead, 1.);
+    if (rampStep >= 0.)
+        mTempoRampStep = rampStep;
+}
+
+double AudioEngine::getTempoLookahead(double* rampStep) const
+{
+    if (rampStep)
+        *rampStep = mTempoRampStep;
+    return mTempoLookahead;
+}
+
+void AudioEngine::setMetronome(bool enabled, int channel, double volume)
+{
+    mMetronome.set(enabled, channel, volume);
+}
+
+bool AudioEngine::getMetronome(int* channel, double* volume) const
+{
+    return mMetronome.get(channel, volume);
+}
+
+void AudioEngine::setMidiClock(bool enabled, int device)
+{
+    mMidiClock.set(enabled, device);
+}
+
+bool AudioEngine::getMidiClock(int* device) const
+{
+    return mMidiClock.get(device);
+}
+
+AudioEngine::Snapshot AudioEngine::snapshot() const
+{
+    return mSnapshot.load();
+}
+
+void AudioEngine::publishSnapshot(const Link::SessionState& sessionState)
+{
+    mSnapshot.store(Snapshot{sessionState, mLink.numPeers()});
+}
+
+void AudioEngine::clearSnapshot()
+{
+    mSnapshot.store(Snapshot{});
+}
+
+void AudioEngine::postEvent(const Event::Type type, const double value)
+{
+    mEvents.push(Event{type, value, mLink.clock().micros()});
+}
+
+int AudioEngine::pollEvents(
+    const std::uint64_t since,
+    std::uint64_t* sequences,
+    Event* events,
+    const int count
+) const
+{
+    auto copied = 0;
+    const auto last = mEvents.last();
+    for (auto sequence = mEvents.next(since);
+         sequence <= last && copied < count;
+         ++sequence)
+    {
+        if (!mEvents.read(sequence, events[copied]))
+            continue;
+        sequences[copied] = sequence;
+        ++copied;
+    }
+    return copied;
+}
+
+// In real-time mode the audio block sync updates the grid, otherwise the
+// timer tick sends its grid. Updated once per block.
+const SessionGrid& AudioEngine::audioGrid(
+    const std::chrono::microseconds hostTime
+)
+{
+    if (hostTime == mAudioGridTime)
+        return mAudioGrid;
+    mAudioGridTime = hostTime;
+    auto grid = SessionGrid{};
+    while (mGridUpdates.pop(grid))
+        mAudioGrid = grid;
+    return mAudioGrid;
+}
+
+void AudioEngine::midiClockCallback(
+    const std::chrono::microseconds hostTime, const std::size_t numSamples
+)
+{
+    if (!mMidiClock.active())
+        return;
+
+    int device{0};
+    mMidiClock.get(&device);
+    auto* output = GetMidiOutput(device);
+    const auto count = mMidiClock.render(
+        audioGrid(hostTime), hostTime, g_abuf_sample_period, (int)numSamples
+    );
+    if (!output)
+        return;
+    const auto* events = mMidiClock.events();
+    for (int i = 0; i < count; ++i)
+    {
+        auto event = MIDI_event_t{events[i].offset, events[i].size, {}};
+        std::copy_n(events[i].message, events[i].size, event.midi_message);
+        output->SendMsg(&event, events[i].offset);
+    }
+}
+
+void AudioEngine::metronomeCallback(
+    const std::chrono::microseconds hostTime,
+    const std::size_t numSamples,
+    ReaSample* left,
+    ReaSample* right
+)
+{
+    if (!mMetronome.get(nullptr, nullptr))
+        return;
+
+    mMetronome.render(
+        audioGrid(hostTime),
+        hostTime,
+        g_abuf_sample_period,
+        (int)numSamples,
+        left,
+        right
+    );
+}
+
+void AudioEngine::postRequest(Request::Type type, double tempo)
+{
+    if (mRequests.push(Request{type, tempo}))
+        return;
+    // mailbox full, keep the latest request of each kind
+    if (type == Request::Type::Tempo)
+        mOverflowTempo = tempo;
+    else
+        mOverflowPlaying = type == Request::Type::Start ? 1 : -1;
+}
+
 void AudioEngine::startPlaying()
 {
-    std::lock_guard<std::mutex> lock(mEngineDataGuard);
-    mSharedEngineData.requestStart = true;
+    postRequest(Request::Type::Start);
 }
 
 void AudioEngine::stopPlaying()
 {
-    std::lock_guard<std::mutex> lock(mEngineDataGuard);
-    mSharedEngineData.requestStop = true;
+    postRequest(Request::Type::Stop);
 }
 
 bool AudioEngine::isPlaying() const
@@ -67,26 +271,22 @@ bool AudioEngine::isPlaying() const
 double AudioEngine::beatTime() const
 {
     const auto sessionState = mLink.captureAppSessionState();
-    return sessionState.beatAtTime(
-        mLink.clock().micros(), mSharedEngineData.quantum
-    );
+    return sessionState.beatAtTime(mLink.clock().micros(), mQuantum.load());
 }
 
 void AudioEngine::setTempo(double tempo)
 {
-    std::lock_guard<std::mutex> lock(mEngineDataGuard);
-    mSharedEngineData.requestedTempo = tempo;
+    postRequest(Request::Type::Tempo, tempo);
 }
 
 double AudioEngine::quantum() const
 {
-    return mSharedEngineData.quantum;
+    return mQuantum;
 }
 
 void AudioEngine::setQuantum(double quantum)
 {
-    std::lock_guard<std::mutex> lock(mEngineDataGuard);
-    mSharedEngineData.quantum = quantum;
+    mQuantum = quantum;
 }
 
 bool AudioEngine::isStartStopSyncEnabled() const
@@ -102,219 +302,667 @@ void AudioEngine::setStartStopSyncEnabled(const bool enabled)
 AudioEngine::EngineData AudioEngine::pullEngineData()
 {
     auto engineData = EngineData{};
-    if (mEngineDataGuard.try_lock())
-    {
-        engineData.requestedTempo = mSharedEngineData.requestedTempo;
-        mSharedEngineData.requestedTempo = 0;
-        engineData.requestStart = mSharedEngineData.requestStart;
-        mSharedEngineData.requestStart = false;
-        engineData.requestStop = mSharedEngineData.requestStop;
-        mSharedEngineData.requestStop = false;
 
-        mLockfreeEngineData.quantum = mSharedEngineData.quantum;
-        mLockfreeEngineData.startStopSyncOn = mSharedEngineData.startStopSyncOn;
+    // requests are applied in arrival order, all at this tick's host time,
+    // so the latest tempo and the latest start/stop are what remain
+    const auto apply = [&engineData](Request::Type type, double tempo) {
+        switch (type)
+        {
+        case Request::Type::Tempo:
+            engineData.requestedTempo = tempo;
+            break;
+        case Request::Type::Start:
+            engineData.requestStart = true;
+            engineData.requestStop = false;
+            break;
+        case Request::Type::Stop:
+            engineData.requestStart = false;
+            engineData.requestStop = true;
+            break;
+        }
+    };
 
-        mEngineDataGuard.unlock();
-    }
-    engineData.quantum = mLockfreeEngineData.quantum;
+    auto request = Request{};
+    while (mRequests.pop(request))
+        apply(request.type, request.tempo);
+
+    if (auto tempo = mOverflowTempo.exchange(0.); tempo > 0.)
+        apply(Request::Type::Tempo, tempo);
+    if (auto playing = mOverflowPlaying.exchange(0); playing != 0)
+        apply(playing > 0 ? Request::Type::Start : Request::Type::Stop, 0.);
+
+    engineData.quantum = mQuantum;
 
     return engineData;
 }
 
-// Function to find a tempo/time signature marker by position
-int FindTempoTimeSigMarkerByPosition(ReaProject* proj, double targetPos)
-{
-    int idx = 0;
-    double pos;
-    int measure;
-    double beat;
-    double bpm;
-    int timesig_num, timesig_denom;
-    bool lineartempo;
-
-    while (true)
-    {
-        if (!GetTempoTimeSigMarker(
-                proj,
-                idx,
-                &pos,
-                &measure,
-                &beat,
-                &bpm,
-                &timesig_num,
-                &timesig_denom,
-                &lineartempo
-            ))
-            break; // No more tempo/time signature markers
+double GetFrameTime()
+{
+    // calculate timer interval average
+    static double time0 = 0.;
+    // REAPER clock, so a headless host can drive it with virtual time
+    auto now_double = time_precise();
+    static RollingAverage frame_time_avg(TIMER_INTERVALS_SIZE);
+    frame_time_avg.add(now_double - time0);
+    time0 = now_double;
+    return frame_time_avg.average();
+}
+
+double GetNextFullMeasureTimePosition(const ProjectCache& cache)
+{
+    double currentPosition = GetCursorPosition(); // Get the current position
+    int measures = 0;
+    int measure_length = 0;
+    cache.timeToBeats(currentPosition, &measures, &measure_length, nullptr);
 
-        if (pos == targetPos)
-            return idx; // Found the tempo/time signature marker
+    auto firstBeatPosition = cache.beatsToTime(0., measures);
+
+    if (currentPosition == firstBeatPosition)
+        return currentPosition;
 
-        ++idx;
+    // the beat after the last one of this measure starts the next
+    return cache.beatsToTime(measure_length, measures);
+}
+
+// first item of track at or after position. REAPER keeps track items in
+// position order.
+int FirstTrackItemAt(MediaTrack* track, const double position)
+{
+    int first{0};
+    int last = CountTrackMediaItems(track);
+    while (first < last)
+    {
+        const auto mid = first + (last - first) / 2;
+        auto* item = GetTrackMediaItem(track, mid);
+        if (GetMediaItemInfo_Value(item, "D_POSITION") < position)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first;
+}
+
+// Tag based cleanup of the regions, tempo markers and items that older
+// versions added to the project for a launch which never finished, e.g.
+// when REAPER crashed or the project was saved mid-launch. They created
+// the pre-roll item on the first track, at the pre-roll region's start.
+void ClearReablinkDummyObjects(ProjectCache& cache)
+{
+    // item positions as saved and reloaded with the project
+    constexpr auto tolerance = 1.0e-6;
+    cache.update();
+    auto* track = GetTrack(0, 0);
+    // walk backwards so enumeration and tempo marker indices of entries not
+    // yet visited stay valid while deleting
+    const auto& markers = cache.markers();
+    for (auto it = markers.rbegin(); it != markers.rend(); ++it)
+    {
+        if (!it->isRegion || it->name.find("reablink") == std::string::npos)
+            continue;
+        if (it->name.find("reablink pre-roll") != std::string::npos)
+        {
+            auto tempo_idx = cache.tempoMarkerAtPosition(it->pos);
+            if (tempo_idx >= 0)
+                DeleteTempoTimeSigMarker(0, tempo_idx);
+            // deleting leaves the indices below unchanged
+            auto i = track ? FirstTrackItemAt(track, it->pos + tolerance) : 0;
+            while (--i >= 0)
+            {
+                auto* item = GetTrackMediaItem(track, i);
+                if (GetMediaItemInfo_Value(item, "D_POSITION") <
+                    it->pos - tolerance)
+                    break;
+                DeleteTrackMediaItem(track, item);
+            }
+        }
+        DeleteProjectMarkerByIndex(0, it->idx);
     }
+    cache.invalidate();
+}
+
+// Launch times are host times at which the block rendered next is heard,
+// like the hostTime of audioCallback. The start latency is seeded by
+// calibration or by launches of earlier sessions on the same device, see
+// applyCalibration, else by one block plus output latency until a launch
+// is measured.
+double AudioEngine::launchLead()
+{
+    if (mStartLatencyCount > 0)
+        return mStartLatency.average() + g_launch_offset_reablink;
+    // REAPER started from the main thread misses the block being rendered
+    // at the earliest
+    const auto block = g_abuf_len * g_abuf_sample_period;
+    return block + outputLatency() + g_launch_offset_reablink;
+}
 
-    return -1; // Not found
+void AudioEngine::planLaunch(
+    Link::SessionState& sessionState,
+    const std::chrono::microseconds hostTime,
+    const double quantum
+)
+{
+    sessionState.requestBeatAtStartPlayingTime(0, quantum);
+    // first downbeat REAPER can still be heard on
+    const auto earliest = sessionState.beatAtTime(
+        hostTime + std::chrono::microseconds(llround(launchLead() * 1.0e6)),
+        quantum
+    );
+    mLaunch = Launch{};
+    mLaunch.targetBeat = std::ceil(earliest / quantum) * quantum;
+    mLaunch.targetPos = GetNextFullMeasureTimePosition(mProjectCache);
+    mLaunchPending = true;
 }
 
-// Function to find a region or marker by name containing a specific substring
-int FindRegionOrMarkerByNameContaining(
-    ReaProject* proj, const std::string& substring
+void AudioEngine::fireLaunch(
+    const Link::SessionState& sessionState,
+    const std::chrono::microseconds hostTime,
+    const double quantum
 )
 {
-    int idx = 0;
-    bool isRegion;
-    double pos, regEnd;
-    int markerId;
-    std::string regionName;
+    const auto target = sessionState.timeAtBeat(mLaunch.targetBeat, quantum);
+    // how much earlier than needed REAPER would be started now, in seconds
+    const auto early = (target - hostTime).count() / 1.0e6 - launchLead();
+    mLaunch.early = early;
+    // a later tick is closer to the fire time, assuming the timer keeps
+    // its current interval
+    if (early > mLastTickInterval)
+        return;
+    // starting early or late by less than a tick is absorbed by the start
+    // position, late if early would start before the project
+    const auto start_pos = mLaunch.targetPos - early;
+    if (start_pos < 0.)
+        return;
+    SetEditCurPos(start_pos, false, false);
+    OnPlayButton();
+    // a late start is past the target measure, leave the edit cursor on it
+    SetEditCurPos(mLaunch.targetPos, false, false);
+    mLaunch.fired = true;
+    mLaunch.fireTime = hostTime;
+    mLaunch.startPos = start_pos;
+    mLaunchPending = false;
+}
 
-    while (true)
+void AudioEngine::measureLaunch(const std::chrono::microseconds hostTime)
+{
+    const auto since_fire = (hostTime - mLaunch.fireTime).count() / 1.0e6;
+    // REAPER position heard at hostTime
+    const auto played = GetPlayPosition2() - mLaunch.startPos;
+    if ((GetPlayState() & 1) && played > 0.)
     {
-        const char* namebuf;
-        if (!EnumProjectMarkers2(
-                proj, idx, &isRegion, &pos, &regEnd, &namebuf, &markerId
-            ))
+        const auto latency = since_fire - played;
+        if (latency > -1. && latency < 1.)
         {
-            break; // No more markers or regions
+            mStartLatency.add(latency);
+            ++mStartLatencyCount;
+            mCalibration.storeLaunchLatency(mStartLatency.average());
         }
+    }
+    else if (since_fire < 1.)
+    {
+        return;
+    }
+    // landed, or REAPER never started; phase correction takes over
+    mLaunch.fired = false;
+    mQuantizedLaunch = false;
+    mResetSync = true;
+}
 
-        regionName = namebuf;
-        if (isRegion && regionName.find(substring) != std::string::npos)
-            return idx; // Found the region or marker
+bool AudioEngine::startCalibration(int runs)
+{
+    if (mIsPlaying || mCalibration.running())
+        return false;
+    mCalibration.update();
+    return mCalibration.start(runs, GetCursorPosition());
+}
 
-        ++idx;
+void AudioEngine::cancelCalibration()
+{
+    mCalibration.cancel();
+}
+
+int AudioEngine::getCalibration(LatencyCalibration::Result* result) const
+{
+    if (result)
+    {
+        const auto* calibrated = mCalibration.result();
+        *result = calibrated ? *calibrated : LatencyCalibration::Result{};
     }
+    return mCalibration.running() ? mCalibration.runsLeft() : 0;
+}
 
-    return -1; // Not found
+void AudioEngine::forgetCalibration()
+{
+    mCalibration.forget();
+    applyCalibration();
 }
 
-double GetFrameTime()
+double AudioEngine::outputLatency() const
 {
-    // calculate timer interval average
-    static std::vector<double> timer_intervals(TIMER_INTERVALS_SIZE, 0.);
+    const auto calibrated = mOutputLatency.load();
+    return calibrated >= 0. ? calibrated : mReaperOutputLatency.load();
+}
 
-    static double time0 = 0.;
-    // auto frame_time = 0.;
-    auto now = std::chrono::high_resolution_clock::now();
-    auto now_double =
-        std::chrono::duration<double>(now.time_since_epoch()).count();
-    static RollingAverage frame_time_avg(512);
-    frame_time_avg.add(now_double - time0);
-    time0 = now_double;
-    return frame_time_avg.average();
+// calibrated start latency, else the one launches last measured on this
+// device, replaces what earlier launches measured, which may have been on
+// another device
+void AudioEngine::applyCalibration()
+{
+    const auto* result = mCalibration.result();
+    mOutputLatency = result ? result->outputLatency : -1.;
+    mStartLatency = RollingAverage(8);
+    mStartLatencyCount = 0;
+    // a calibrated start latency may be slightly negative
+    const auto seed =
+        result ? result->startLatency : mCalibration.launchLatency();
+    if (result || seed >= 0.)
+    {
+        mStartLatency.add(seed);
+        mStartLatencyCount = 1;
+    }
 }
 
-double GetNextFullMeasureTimePosition()
+void AudioEngine::setTickIntervals(int fast, int normal, int idle)
 {
-    double currentPosition = GetCursorPosition(); // Get the current position
-    int measures = 0;
-    auto beats = TimeMap2_timeToBeats(0, currentPosition, &measures, 0, 0, 0);
-    (void)beats;
+    const auto set = [](std::atomic_int& interval, int ms) {
+        if (ms > 0)
+            interval = std::min(ms, 1000);
+    };
+    set(mTickFast, fast);
+    set(mTickNormal, normal);
+    set(mTickIdle, idle);
+}
 
-    auto firstBeatPosition = TimeMap2_beatsToTime(0, 0, &measures);
+int AudioEngine::tickInterval() const
+{
+    return mTickInterval;
+}
 
-    if (currentPosition == firstBeatPosition)
-        return currentPosition;
+// Fast around launches, tempo changes and loop wraps, where the tick rate
+// limits timing. Idle when nothing plays, or when playing without peers
+// and Link is locked to REAPER.
+int AudioEngine::nextTickInterval(
+    const Link::SessionState& sessionState,
+    const double position,
+    const double tickTime
+)
+{
+    const auto near = 4. * mTickNormal / 1000.;
+    if ((mLaunchPending && mLaunch.early < near) || mLaunch.fired ||
+        tickTime < mFastTicksUntil)
+        return mTickFast;
 
-    int measures3 = 0;
-    int beats3 = 0;
-
-    int measurePosition = (int)TimeMap2_timeToBeats(
-        0,
-        currentPosition,
-        &measures3,
-        &beats3,
-        NULL,
-        NULL
-    ); // Convert the current position to beats
-    (void)measurePosition;
-    return TimeMap2_beatsToTime(
-        0,
-        beats3,
-        &measures3
-    ); // Convert the next full measure position to time
-}
-
-int SetLaunchPrerollRegion()
-{
-    double projectLength = GetProjectLength(0); // Get the length of the project
-    int measures3 = 0;
-    int beats3 = 0;
-    double num_measures = TimeMap2_timeToBeats(
-        0,
-        projectLength,
-        &measures3,
-        &beats3,
-        NULL,
-        NULL
-    ); // Convert the project length to measures/beats
-    auto region_start = TimeMap2_beatsToTime(0, beats3, &measures3);
-    auto pos = GetNextFullMeasureTimePosition();
-
-    num_measures = TimeMap2_timeToBeats(
-        0,
-        region_start,
-        &measures3,
-        &beats3,
-        NULL,
-        NULL
-    ); // Convert the project length to measures/beats
-    auto region_end = TimeMap2_beatsToTime(0, beats3, &measures3);
-
-    (void)pos;
-    (void)num_measures;
-    // Add the region to the project
-    int isRegion = true; // We want to create a region, not a marker
-    int color = 0;       // The color of the region (0 = default color)
-    return AddProjectMarker2(
-        0, isRegion, region_start, region_end, "reablink pre-roll", -1, color
+    const auto playing = (GetPlayState() & 1) != 0;
+    if (playing && GetSetRepeat(-1) == 1)
+    {
+        double loop_start{0};
+        double loop_end{0};
+        GetSet_LoopTimeRange(false, false, &loop_start, &loop_end, false);
+        // jump detection and correction right after the wrap
+        if (loop_end > loop_start &&
+            ((position > loop_end - near && position <= loop_end) ||
+             (position >= loop_start && position < loop_start + near)))
+            return mTickFast;
+    }
+
+    if (!mIsPlaying && !sessionState.isPlaying() && !playing)
+        return mTickIdle;
+    if (mIsPlaying && mLink.numPeers() == 0 &&
+        std::abs(g_timeline_offset_reablink) < 0.001) // NOLINT
+        return mTickIdle;
+    return mTickNormal;
+}
+
+void AudioEngine::updateLoopRange(const bool projectChanged)
+{
+    auto loop = LoopRange{};
+    loop.repeat = GetSetRepeat(-1) == 1;
+    GetSet_LoopTimeRange(false, false, &loop.start, &loop.end, false);
+    if (!projectChanged && loop.repeat == mLoopRange.repeat &&
+        loop.start == mLoopRange.start && loop.end == mLoopRange.end)
+        return;
+    int measures{0};
+    loop.startBeat = mProjectCache.timeToBeats(loop.start, &measures, 0, 0);
+    loop.endBeat = mProjectCache.timeToBeats(loop.end, &measures, 0, 0);
+    mLoopRange = loop;
+    mLoopUpdates.push(loop);
+}
+
+// Wraps between the previous sync step and this one: where REAPER would
+// be without the loop, folded back into the loop range. A position that
+// does not match is a seek and left to jump detection.
+// Link has one tempo for the whole timeline, a change is heard by peers
+// as soon as it is committed. Tempo steps, including loop wraps, are
+// committed once they are within lookahead, anchored at the step, so Link
+// beats match REAPER's from the step on; a step passed since the last tick
+// is anchored at the step too. Ramps are committed as the tempo that meets
+// REAPER's beat at the end of lookahead, including what earlier ramp
+// commits fell behind, and only once that moved by the ramp step.
+double AudioEngine::broadcastTempo(
+    Link::SessionState& sessionState,
+    const std::chrono::microseconds hostTime,
+    const double position,
+    const double hostBpm
+)
+{
+    const auto lookahead = mTempoLookahead.load();
+    const auto playrate = Master_GetPlayRate(0);
+    if (!(lookahead > 0.) || !(playrate > 0.))
+        return hostBpm;
+
+    // position of the next block, heard at hostTime
+    const auto heard = position;
+    const auto ahead = heard + lookahead * playrate;
+    const auto recent = heard - mLastTickInterval * playrate;
+    const auto& loop = mLoopRange;
+    const auto wraps = loop.repeat && heard < loop.end && ahead >= loop.end;
+    const auto wrapped =
+        loop.repeat && heard >= loop.start && loop.start > recent;
+
+    const auto idx = mProjectCache.tempoMarkerAt(heard);
+    const auto* marker = mProjectCache.tempoMarker(idx);
+    const auto* next = mProjectCache.tempoMarker(idx + 1);
+    auto bpm = hostBpm;
+    auto step = -1.; // REAPER project time of a tempo step
+    if (wraps)
+    {
+        mProjectCache.timeSigAt(loop.start, nullptr, nullptr, &bpm);
+        step = loop.end;
+    }
+    else if (marker && marker->linear && next)
+    {
+        // quarter notes Link fell behind REAPER since the ramp started
+        auto behind = 0.;
+        if (mRamp.bpm == sessionState.tempo() && heard > mRamp.position &&
+            heard - mRamp.position < 1.)
+            behind = mRamp.behind + mProjectCache.timeToQN(heard) -
+                     mProjectCache.timeToQN(mRamp.position) -
+                     mRamp.bpm * (heard - mRamp.position) / 60.;
+        bpm = (mProjectCache.timeToQN(ahead) - mProjectCache.timeToQN(heard) +
+               behind) *
+              60. / (ahead - heard);
+        if (std::abs(bpm - sessionState.tempo()) < mTempoRampStep)
+            return sessionState.tempo();
+        mRamp = TempoRamp{heard, bpm, behind};
+    }
+    else if (next && next->time <= ahead)
+    {
+        bpm = next->bpm;
+        step = next->time;
+    }
+    else if (marker && marker->time > recent)
+    {
+        step = marker->time;
+    }
+    else if (wrapped)
+    {
+        mProjectCache.timeSigAt(heard, nullptr, nullptr, &bpm);
+        step = loop.start;
+    }
+
+    if (bpm == sessionState.tempo())
+        return bpm;
+    auto at = hostTime;
+    if (step >= 0.)
+        at += std::chrono::microseconds(
+            llround((step - heard) / playrate * 1.0e6) // NOLINT
+        );
+    sessionState.setTempo(bpm, at);
+    return bpm;
+}
+
+int AudioEngine::predictLoopWraps(
+    const double position,
+    const std::chrono::microseconds hostTime,
+    const double playrate
+)
+{
+    const auto& loop = mSyncLoop;
+    const auto length = loop.end - loop.start;
+    const auto previous = mSyncPrevPosition;
+    const auto elapsed = (hostTime - mSyncPrevHostTime).count() / 1.0e6;
+    mSyncPrevPosition = position;
+    mSyncPrevHostTime = hostTime;
+    if (!loop.repeat || !(length > 0.) || previous < loop.start ||
+        previous >= loop.end || elapsed <= 0. || elapsed > 1.)
+        return 0;
+
+    const auto expected = previous + elapsed * playrate;
+    if (expected < loop.end)
+        return 0;
+    const auto wraps = std::floor((expected - loop.start) / length);
+    const auto landing = expected - wraps * length;
+    const auto tolerance = std::min(0.05, length / 4.); // NOLINT
+    if (std::abs(position - landing) > tolerance)
+        return 0;
+    return (int)wraps;
+}
+
+PlayCursor::Segment AudioEngine::tempoSegment(const double time)
+{
+    auto segment = PlayCursor::Segment{};
+    int measures{0};
+    segment.start = time;
+    segment.qn = mProjectCache.timeToQN(time);
+    segment.beat = mProjectCache.timeToBeats(
+        time, &measures, &segment.num, &segment.denom
     );
+    mProjectCache.timeSigAt(time, nullptr, nullptr, &segment.bpm);
+    const auto idx = mProjectCache.tempoMarkerAt(time);
+    const auto* marker = mProjectCache.tempoMarker(idx);
+    const auto* next = mProjectCache.tempoMarker(idx + 1);
+    segment.end = next ? next->time : std::numeric_limits<double>::max();
+    if (marker && marker->linear && next && next->time > marker->time)
+        segment.ramp = (next->bpm - marker->bpm) / (next->time - marker->time);
+    return segment;
 }
 
-void ClearReablinkDummyObjects()
+// An audio block may have run since the tick read its host time, the
+// position read now is then heard that much later.
+PlayCursor AudioEngine::playCursor(const std::chrono::microseconds hostTime)
 {
-    int n = CountProjectMarkers(0, 0, 0);
-    while (n-- > 0)
+    auto cursor = PlayCursor{};
+    const auto playing = (GetPlayState() & 1) != 0;
+    const auto buffer_time = g_abuf_time.load();
+    cursor.position = playing ? GetPlayPosition2() : GetCursorPosition();
+    cursor.playrate = playing ? Master_GetPlayRate(0) : 0.;
+    cursor.commands = mCommandsRun;
+    const auto since_tick = llround((buffer_time - mTickBufferTime) * 1.0e6);
+    cursor.time = hostTime + std::chrono::microseconds(since_tick);
+    cursor.repeat = mLoopRange.repeat;
+    cursor.loopStart = mLoopRange.start;
+    cursor.loopEnd = mLoopRange.end;
+    cursor.segment = tempoSegment(cursor.position);
+    if (cursor.repeat)
+        cursor.loopSegment = tempoSegment(cursor.loopStart);
+    return cursor;
+}
+
+// The sync loop state and the audio session state belong to one thread
+// at a time. The tick hands them to the audio thread when real-time mode
+// is requested, and takes them back when it is not, but only between
+// audio blocks: a busy audio thread cannot be overtaken, so a block in
+// flight when the mode changes finishes before the tick syncs again.
+bool AudioEngine::handOverSync()
+{
+    auto owner = mSyncOwner.load();
+    if (isRealtime && owner == SyncOwner::Timer)
     {
-        int idx = FindRegionOrMarkerByNameContaining(0, "reablink");
-        if (idx == -1)
-            break;
-        const char* namebuf;
-        double pos{0};
-        EnumProjectMarkers(idx, NULL, &pos, NULL, &namebuf, NULL);
-        if (namebuf != nullptr &&
-            strstr(namebuf, "reablink pre-roll") != nullptr)
+        // the tick owns both ends of the cursor queue until now
+        auto cursor = PlayCursor{};
+        while (mCursorUpdates.pop(cursor))
+            ;
+        mCursor = PlayCursor{};
+        mSyncOwner = SyncOwner::Audio;
+        mResetSync = true;
+        return true;
+    }
+    if (!isRealtime && owner == SyncOwner::Audio &&
+        mSyncOwner.compare_exchange_strong(owner, SyncOwner::Timer))
+    {
+        mResetSync = true;
+        return false;
+    }
+    // a busy block keeps it until a later tick
+    return owner != SyncOwner::Timer;
+}
+
+bool AudioEngine::claimSync()
+{
+    auto owner = SyncOwner::Audio;
+    return mSyncOwner.compare_exchange_strong(owner, SyncOwner::AudioBusy);
+}
+
+void AudioEngine::releaseSync()
+{
+    mSyncOwner = SyncOwner::Audio;
+}
+
+void AudioEngine::issueCommand(int command, bool fromAudioThread)
+{
+    if (!fromAudioThread)
+    {
+        Main_OnCommand(command, 0);
+        return;
+    }
+    if (!mCommands.push(Command{Command::Type::MainOnCommand, command, 0.}))
+        return;
+    ++mCommandsIssued;
+    switch (command)
+    {
+    case 40521:
+        mCommandedPlayrate = 1.;
+        break;
+    case 40524:
+        mCommandedPlayrate *= PLAYRATE_STEP;
+        break;
+    case 40525:
+        mCommandedPlayrate /= PLAYRATE_STEP;
+        break;
+    }
+}
+
+void AudioEngine::issuePlayrate(double playrate, bool fromAudioThread)
+{
+    if (!fromAudioThread)
+    {
+        CSurf_OnPlayRateChange(playrate);
+        return;
+    }
+    if (!mCommands.push(Command{Command::Type::SetPlayRate, 0, playrate}))
+        return;
+    ++mCommandsIssued;
+    mCommandedPlayrate = playrate;
+}
+
+void AudioEngine::runCommands()
+{
+    auto command = Command{};
+    while (mCommands.pop(command))
+    {
+        ++mCommandsRun;
+        switch (command.type)
         {
-            DeleteTempoTimeSigMarker(
-                0, FindTempoTimeSigMarkerByPosition(0, pos)
-            );
-            for (int i = CountMediaItems(0); i > -1; i--)
-            {
-                auto item = GetMediaItem(0, i);
-                if (GetMediaItemInfo_Value(item, "D_POSITION") == pos)
-                    DeleteTrackMediaItem(GetMediaItem_Track(item), item);
-            }
+        case Command::Type::MainOnCommand:
+            Main_OnCommand(command.id, 0);
+            break;
+        case Command::Type::SetPlayRate:
+            CSurf_OnPlayRateChange(command.value);
+            break;
         }
-        DeleteProjectMarkerByIndex(0, idx);
     }
 }
 
+LogHistogram<> AudioEngine::getStats(Stat stat) const
+{
+    return mStats[(size_t)stat].snapshot();
+}
+
+void AudioEngine::resetStats()
+{
+    for (auto& stat : mStats)
+        stat.reset();
+}
+
+void AudioEngine::recordStat(Stat stat, StatClock::time_point since)
+{
+    mStats[(size_t)stat].add(
+        std::chrono::duration<double, std::nano>(StatClock::now() - since)
+            .count()
+    );
+}
+
+bool AudioEngine::setTraceFile(const char* path)
+{
+    if (!path || !*path)
+    {
+        mTrace.close();
+        return true;
+    }
+    return mTrace.open(path);
+}
+
+bool AudioEngine::isTracing() const
+{
+    return mTrace.isOpen();
+}
+
 void AudioEngine::audioCallback(
     const std::chrono::microseconds hostTime, const std::size_t numSamples
 )
 {
-    static bool quantized_launch{false};
-    auto frame_time = GetFrameTime();
-    static int frame_count{0};
-    static double qn_prev{0};
-    static int preroll_region_idx{0};
-    static int target_region_idx{0};
-    static double jump_offset{0};
-    static double land_offset{0};
-    static bool launch_cleared{false};
+    static double timeline_updated{0.};
+
+    const auto tick_start = StatClock::now();
+    if (mLastTickStart != StatClock::time_point{})
+        recordStat(Stat::TickInterval, mLastTickStart);
+    mLastTickStart = tick_start;
+    const auto tick_time = time_precise();
+    mLastTickInterval = tick_time - mLastTickTime;
+    mLastTickTime = tick_time;
+    mTickBufferTime = g_abuf_time;
+    mReaperOutputLatency = GetOutputLatency();
+
+    // commands deferred by the audio thread since last tick
+    runCommands();
+    // peers or transport changed since last tick, sync closely for a while
+    {
+        auto event = Event{};
+        for (auto sequence = mEvents.next(mEventsSeen);
+             sequence <= mEvents.last();
+             ++sequence)
+        {
+            if (mEvents.read(sequence, event) &&
+                event.type != Event::Type::Tempo)
+                mFastTicksUntil = tick_time + 0.5; // NOLINT
+            mEventsSeen = sequence;
+        }
+    }
+    mTrace.flush();
+    if (mCalibration.update())
+        applyCalibration();
+    // calibration owns the transport until done
+    if (mCalibration.running())
+    {
+        if (mCalibration.tick(hostTime))
+            applyCalibration();
+        publishSnapshot(mLink.captureAppSessionState());
+        mTickInterval = mTickFast;
+        recordStat(Stat::Tick, tick_start);
+        return;
+    }
+    updateLoopRange(mProjectCache.update());
+
+    mFrameTime = GetFrameTime();
+    mToggle40620 = GetToggleCommandState(40620) != 0;
+    const bool realtime = handOverSync();
 
     const auto engineData = pullEngineData();
 
-    auto sessionState = mLink.captureAudioSessionState();
+    // in real-time mode the audio thread owns the audio session state
+    auto phase_start = StatClock::now();
+    auto sessionState = realtime ? mLink.captureAppSessionState()
+                                 : mLink.captureAudioSessionState();
+    recordStat(Stat::Capture, phase_start);
 
     if (engineData.requestStart)
         sessionState.setIsPlaying(true, hostTime);
@@ -324,101 +972,20 @@ void AudioEngine::audioCallback(
 
     if (isPuppet && !mIsPlaying && sessionState.isPlaying())
     {
-        PreventUIRefresh(3);
-        qn_prev = 0;
-        Undo_BeginBlock();
-        if (mLink.numPeers() > 0 && GetToggleCommandState(40620) == 0)
+        mResetSync = true;
+        ClearReablinkDummyObjects(mProjectCache);
+        if (mLink.numPeers() > 0 && !mToggle40620)
         {
+            // REAPER is started by a later tick, see fireLaunch
             sessionState.setTempo(sessionState.tempo(), hostTime);
-            auto pos_target = GetNextFullMeasureTimePosition();
-            int timesig_num = 0;
-            int timesig_denom = 0;
-            double tempo = 0;
-            TimeMap_GetTimeSigAtTime(
-                0, pos_target, &timesig_num, &timesig_denom, &tempo
-            );
-            target_region_idx = AddProjectMarker2(
-                0,
-                true,
-                pos_target,
-                pos_target + (60. / tempo * engineData.quantum),
-                "reablink target",
-                -1,
-                0
-            );
-            auto target_tempo_idx = FindTempoTimeSigMarker(0, pos_target);
-            SetTempoTimeSigMarker(
-                0,
-                target_tempo_idx,
-                pos_target,
-                0,
-                0,
-                sessionState.tempo(),
-                timesig_num,
-                timesig_denom,
-                false
-            );
-            preroll_region_idx = SetLaunchPrerollRegion();
-            sessionState.requestBeatAtStartPlayingTime(0, engineData.quantum);
-            auto beat_now =
-                sessionState.beatAtTime(hostTime, engineData.quantum);
-            auto beat_offset = engineData.quantum - abs(beat_now);
-            double pos_preroll{0};
-            for (int i = 0; i < CountProjectMarkers(0, 0, 0); i++)
-            {
-                int region_idx{0};
-                bool isRegion{false};
-                EnumProjectMarkers(
-                    i, &isRegion, &pos_preroll, NULL, NULL, &region_idx
-                );
-                if (isRegion && region_idx == preroll_region_idx)
-                    break;
-            }
-
-            SetTempoTimeSigMarker(
-                0,
-                -1,
-                pos_preroll,
-                0,
-                0,
-                sessionState.tempo(),
-                timesig_num,
-                timesig_denom,
-                false
-            );
-            FindTempoTimeSigMarker(0, pos_preroll);
-
-            MediaTrack* track = GetTrack(0, 0); // Get the first track
-
-            // Create the new MIDI item
-
-            CreateNewMIDIItemInProj(
-                track,
-                pos_preroll,
-                pos_preroll + (60. / sessionState.tempo() * engineData.quantum),
-                0
-            );
-
-            int measures{0};
-            TimeMap2_timeToBeats(0, pos_preroll, &measures, 0, 0, 0);
-            auto pos_preroll_start =
-                TimeMap2_beatsToTime(0, beat_offset, &measures);
-            SetEditCurPos(
-                pos_preroll_start +
-                    (hostTime - mLink.clock().micros()).count() / 1.0e6,
-                false,
-                false
-            );
-
-            quantized_launch = true;
+            planLaunch(sessionState, hostTime, engineData.quantum);
+            mQuantizedLaunch = true;
+        }
+        else
+        {
+            OnPlayButton();
         }
-        frame_count = 0;
-        OnPlayButton();
-        jump_offset = 0;
-        land_offset = 0;
         mIsPlaying = true;
-        launch_cleared = false;
-        PreventUIRefresh(-3);
     }
     else if (isPuppet && mIsPlaying && !sessionState.isPlaying())
     {
@@ -426,15 +993,13 @@ void AudioEngine::audioCallback(
         OnStopButton();
         Main_OnCommand(40521, 0);
         mIsPlaying = false;
-        qn_prev = 0;
-        launch_cleared = false;
-        quantized_launch = false;
-        ClearReablinkDummyObjects();
-        Undo_EndBlock("ReaBlink", -1);
+        mResetSync = true;
+        mQuantizedLaunch = false;
+        mLaunchPending = false;
+        mLaunch = Launch{};
     }
     else if (isPuppet && !mIsPlaying && !sessionState.isPlaying() && GetPlayState() & 1)
     {
-        ClearReablinkDummyObjects();
         OnStopButton();
     }
 
@@ -446,144 +1011,50 @@ void AudioEngine::audioCallback(
     int timesig_num{0};
     int timesig_denom{0};
     int ptidx{0};
+    phase_start = StatClock::now();
     auto r_pos = GetPlayState() & 1 ? GetPlayPosition2() : GetCursorPosition();
-    TimeMap_GetTimeSigAtTime(0, r_pos, &timesig_num, &timesig_denom, &hostBpm);
-    ptidx = FindTempoTimeSigMarker(0, r_pos);
-    GetTempoTimeSigMarker(0, ptidx, &timepos, 0, 0, 0, 0, 0, 0);
+    // launch and stop above may have edited the project
+    if (mProjectCache.update())
+        updateLoopRange(true);
+    mProjectCache.timeSigAt(r_pos, &timesig_num, &timesig_denom, &hostBpm);
+    ptidx = mProjectCache.tempoMarkerAt(r_pos);
+    if (const auto* marker = mProjectCache.tempoMarker(ptidx))
+        timepos = marker->time;
 
     // update local quantum
     if (quantum() != (double)timesig_num / timesig_denom * 4.)
         setQuantum((double)timesig_num / timesig_denom * 4.);
+    mSyncQuantum = engineData.quantum;
+    recordStat(Stat::TimeMap, phase_start);
 
     if (mIsPlaying)
     {
-        if (isPuppet && frame_count == 1 && mLink.numPeers() > 0)
-        {
-            GoToRegion(0, target_region_idx, false);
-            quantized_launch = false;
-        }
-
-        if (!launch_cleared)
-        {
-            int current_idx{0};
-            int region_idx{0};
-            bool isRegion{false};
-            GetLastMarkerAndCurRegion(0, GetPlayPosition(), 0, &current_idx);
-            EnumProjectMarkers(current_idx, &isRegion, 0, 0, 0, &region_idx);
-            if (isRegion && region_idx == target_region_idx)
-            {
-                launch_cleared = true;
-                ClearReablinkDummyObjects();
-            }
-        }
-
-        // set tempo if host /
-        //   timeline has changed it
-        if (sessionState.beatAtTime(hostTime, engineData.quantum) > 0. &&
-            hostBpm != sessionState.tempo() &&
-            !(engineData.requestedTempo > 0.))
-        {
-            sessionState.setTempo(hostBpm, hostTime);
-        }
-
-        // get current qn/beat position
-        auto pos = GetPlayPosition2();
-        int measures{0};
-        auto beat = TimeMap2_timeToBeats(
-            0, pos, &measures, &timesig_num, 0, &timesig_denom
-        );
-
-        auto qn_abs = TimeMap2_timeToQN(0, pos);
-
-        // handle looping/jumps
-        if (abs(qn_abs - qn_prev) > 0.5 &&
-            sessionState.beatAtTime(hostTime, engineData.quantum) > 1.)
-        {
-            if (GetSetRepeat(-1) == 1)
-            {
-                double start_pos{0};
-                double end_pos{0};
-                GetSet_LoopTimeRange(false, false, &start_pos, &end_pos, false);
-                if (pos > start_pos && pos < end_pos)
-                {
-                    auto start_beat =
-                        TimeMap2_timeToBeats(0, start_pos, &measures, 0, 0, 0);
-                    auto end_beat =
-                        TimeMap2_timeToBeats(0, end_pos, &measures, 0, 0, 0);
-                    jump_offset = fmod(jump_offset + end_beat, 1.0);
-                    land_offset = fmod(land_offset + start_beat, 1.0);
-                }
-            }
-            else
-            {
-                sessionState.requestBeatAtTime(
-                    fmod(beat, 1.), hostTime, 4. / timesig_denom
-                );
-            }
-        }
-        qn_prev = qn_abs;
-        auto reaper_phase_current = fmod(beat - land_offset + jump_offset, 1.0);
-
-        // sync
-        auto link_phase_current =
-            sessionState.phaseAtTime(hostTime, 4. / timesig_denom) *
-            (timesig_denom / 4);
-        auto reaper_phase_time =
-            reaper_phase_current * 60. / sessionState.tempo();
-        auto link_phase_time =
-            fmod(link_phase_current, 1.0) * 60. / sessionState.tempo();
-
-        auto diff = (reaper_phase_time - link_phase_time);
-        static RollingAverage diff_avg(8);
-        diff_avg.add(diff);
-        diff = diff_avg.average();
-        g_timeline_offset_reablink = diff;
-
-        auto buf_len_time = GetOutputLatency();
-        double limit_denom = 8.;
-        if (buf_len_time / (numSamples / g_abuf_srate) > 3)
-            limit_denom = 1.0;
-        static auto limit = std::max(
-            frame_time / limit_denom,
-            buf_len_time / limit_denom
-        ); // seconds
-
-        if (!isMaster && isPuppet && mLink.numPeers() > 0 &&
-            !quantized_launch &&
-            (sessionState.beatAtTime(hostTime, engineData.quantum) < 0 ||
-             sessionState.beatAtTime(hostTime, engineData.quantum) > 1.666) &&
-            abs(diff) > limit &&
-            abs(reaper_phase_current - link_phase_current) < 0.5 &&
-            GetToggleCommandState(40620) == 0)
+        if (mLaunchPending)
+            fireLaunch(sessionState, hostTime, engineData.quantum);
+        else if (mLaunch.fired)
+            measureLaunch(hostTime);
+
+        // tempo requests from scripts and peers win over the tempo map
+        const auto broadcast = isMaster && !mLaunchPending &&
+                               engineData.requestedTempo <= 0. &&
+                               GetPlayState() & 1;
+        if (broadcast)
+            hostBpm = broadcastTempo(sessionState, hostTime, r_pos, hostBpm);
+        mMasterTempo = broadcast ? hostBpm : 0.;
+
+        if (!realtime && !mLaunchPending)
         {
-            limit = std::max(
-                frame_time / limit_denom / 2,
-                buf_len_time / limit_denom / 2
-            ); // seconds
-            if (reaper_phase_time > link_phase_time &&
-                Master_GetPlayRate(0) >= 1)
-            {
-                Main_OnCommand(40525, 0);
-                Main_OnCommand(40525, 0);
-            }
-            else if (reaper_phase_time < link_phase_time && Master_GetPlayRate(0) <= 1)
-            {
-                Main_OnCommand(40524, 0);
-                Main_OnCommand(40524, 0);
-            }
-        }
-        else if (!isMaster && isPuppet && mLink.numPeers() > 0 && abs(diff) < limit && Master_GetPlayRate(0) != 1)
-        {
-            limit = std::max(
-                frame_time / limit_denom,
-                buf_len_time / limit_denom
-            ); // seconds
-            Main_OnCommand(40521, 0);
-        }
-        else if ((mLink.numPeers() == 0 || isMaster) && abs(diff) > limit)
-        {
-            double beats = TimeMap2_timeToQN(0, pos);
-            sessionState.forceBeatAtTime(beats, hostTime, engineData.quantum);
+            phase_start = StatClock::now();
+            syncTimeline(
+                sessionState,
+                hostTime,
+                numSamples,
+                engineData.quantum,
+                hostBpm,
+                engineData.requestedTempo > 0.,
+                false
+            );
+            recordStat(Stat::Correction, phase_start);
         }
     }
 
@@ -597,20 +1068,15 @@ void AudioEngine::audioCallback(
     if (isPuppet && engineData.requestedTempo > 0)
     {
         auto new_tempo = engineData.requestedTempo;
-        if (GetSetRepeat(-1) == 1)
+        if (mLoopRange.repeat)
         {
-            double loop_start{0};
-            double loop_end{0};
             int measures{0};
-            GetSet_LoopTimeRange(false, false, &loop_start, &loop_end, false);
-            auto loop_end_beat = TimeMap2_timeToBeats(0, loop_end, 0, 0, 0, 0);
-            auto beat = TimeMap2_timeToBeats(0, r_pos, 0, 0, 0, 0);
-            if ((r_pos > loop_start && r_pos < loop_end) &&
-                abs(beat - loop_end_beat) < 1)
+            auto beat = mProjectCache.timeToBeats(r_pos, &measures, 0, 0);
+            if ((r_pos > mLoopRange.start && r_pos < mLoopRange.end) &&
+                std::abs(beat - mLoopRange.endBeat) < 1)
             {
                 new_tempo = hostBpm;
             }
-            (void)measures;
         }
         if (!SetTempoTimeSigMarker(
                 0,
@@ -628,13 +1094,210 @@ void AudioEngine::audioCallback(
         }
     }
 
-    frame_count++;
-    if (isPuppet && frame_count % 12 == 0) // NOLINT
+    if (isPuppet && tick_time - timeline_updated > 0.144) // NOLINT
+    {
+        timeline_updated = tick_time;
         UpdateTimeline();
+    }
+
+    if (engineData.requestedTempo > 0)
+        mFastTicksUntil = tick_time + 0.5; // NOLINT
+    mTickInterval = nextTickInterval(sessionState, r_pos, tick_time);
+
+    // after launch, stop and playrate commands of this tick
+    if (realtime)
+        mCursorUpdates.push(playCursor(hostTime));
 
     // Timeline modifications are complete, commit the results
+    phase_start = StatClock::now();
+    if (realtime)
+        mLink.commitAppSessionState(sessionState);
+    else
+        mLink.commitAudioSessionState(sessionState);
+    recordStat(Stat::Commit, phase_start);
+    publishSnapshot(sessionState);
+
+    if (!realtime && (mMetronome.get(nullptr, nullptr) || mMidiClock.active()))
+        mGridUpdates.push(
+            SessionGrid::of(sessionState, hostTime, engineData.quantum)
+        );
+    recordStat(Stat::Tick, tick_start);
+}
+
+void AudioEngine::audioBlockCallback(
+    const std::chrono::microseconds hostTime, const std::size_t numSamples
+)
+{
+    if (!claimSync())
+        return;
+
+    const auto block_start = StatClock::now();
+    auto cursor = PlayCursor{};
+    while (mCursorUpdates.pop(cursor))
+        mCursor = cursor;
+    const auto sync =
+        mIsPlaying && !mLaunchPending && mCursor.time.count() != 0;
+    const auto grid = mMetronome.get(nullptr, nullptr) || mMidiClock.active();
+    if (!sync && !grid)
+    {
+        releaseSync();
+        return;
+    }
+    auto sessionState = mLink.captureAudioSessionState();
+    if (!sync)
+    {
+        mAudioGrid = SessionGrid::of(sessionState, hostTime, mQuantum);
+        mAudioGridTime = hostTime;
+        releaseSync();
+        return;
+    }
+
+    // Master tempo is committed ahead of the tempo map by the timer tick
+    auto hostBpm = mMasterTempo.load();
+    if (!(hostBpm > 0.))
+    {
+        const auto pos = mCursor.positionAt(hostTime);
+        hostBpm = mCursor.segmentAt(pos).bpmAt(pos);
+    }
+
+    const auto phase_start = StatClock::now();
+    syncTimeline(
+        sessionState, hostTime, numSamples, mSyncQuantum, hostBpm, false, true
+    );
+    recordStat(Stat::BlockCorrection, phase_start);
+
     mLink.commitAudioSessionState(sessionState);
+    if (grid)
+    {
+        mAudioGrid = SessionGrid::of(sessionState, hostTime, mQuantum);
+        mAudioGridTime = hostTime;
+    }
+    releaseSync();
+    recordStat(Stat::Block, block_start);
+}
+
+void AudioEngine::syncTimeline(
+    Link::SessionState& sessionState,
+    const std::chrono::microseconds hostTime,
+    const std::size_t numSamples,
+    const double quantum,
+    const double hostBpm,
+    const bool tempoRequested,
+    const bool fromAudioThread
+)
+{
+    auto input = SyncInput{};
+    input.hostTime = hostTime.count();
+    const auto set_flag = [&input](bool on, SyncInput::Flags flag) {
+        if (on)
+            input.flags |= flag;
+    };
+    set_flag(mResetSync.exchange(false), SyncInput::Reset);
+    set_flag(isMaster, SyncInput::Master);
+    set_flag(isPuppet, SyncInput::Puppet);
+    set_flag(mQuantizedLaunch, SyncInput::QuantizedLaunch);
+    set_flag(mToggle40620, SyncInput::Toggle40620);
+    set_flag(tempoRequested, SyncInput::TempoRequested);
+    set_flag(fromAudioThread, SyncInput::FromAudioThread);
+    input.numPeers = (int32_t)mLink.numPeers();
+    input.sessionTempo = sessionState.tempo();
+    input.sessionBeat = sessionState.beatAtTime(hostTime, quantum);
+    input.hostBpm = hostBpm;
+
+    // get current qn/beat position. REAPER's API and the project cache
+    // belong to the main thread, the audio thread follows the tick's play
+    // cursor.
+    auto pos = 0.;
+    if (fromAudioThread)
+    {
+        pos = mCursor.positionAt(hostTime);
+        const auto& segment = mCursor.segmentAt(pos);
+        input.beat = segment.beatAt(pos);
+        input.timesigNum = segment.num;
+        input.timesigDenom = segment.denom;
+        input.qn = segment.qnAt(pos);
+        // REAPER applies commands on the next tick, until then the
+        // playrate is what they will set, so they are not issued again
+        if (mCursor.commands == mCommandsIssued)
+            mCommandedPlayrate = mCursor.playrate;
+        input.playrate = mCommandedPlayrate;
+    }
+    else
+    {
+        int measures{0};
+        pos = GetPlayPosition2();
+        input.beat = mProjectCache.timeToBeats(
+            pos, &measures, &input.timesigNum, &input.timesigDenom
+        );
+        input.qn = mProjectCache.timeToQN(pos);
+        input.playrate = Master_GetPlayRate(0);
+    }
+    input.position = pos;
+
+    // loop range, precomputed by the timer tick
+    auto loop_update = LoopRange{};
+    while (mLoopUpdates.pop(loop_update))
+        mSyncLoop = loop_update;
+    // REAPER timeline follows the audio clock, Link the host clock
+    const auto drift = mClockDrift.load();
+    input.basePlayrate = mDriftCompensation && std::abs(drift) < 500. // NOLINT
+                             ? 1. / (1. + drift * 1.0e-6)
+                             : 1.;
+    if (input.flags & SyncInput::Reset)
+        mSyncPrevHostTime = std::chrono::microseconds{0};
+    input.loopWraps = predictLoopWraps(pos, hostTime, input.playrate);
+    if (mSyncLoop.repeat)
+    {
+        input.flags |= SyncInput::Repeat;
+        if (pos >= mSyncLoop.start && pos < mSyncLoop.end)
+            input.flags |= SyncInput::InLoop;
+        input.loopStartBeat = mSyncLoop.startBeat;
+        input.loopEndBeat = mSyncLoop.endBeat;
+    }
+
+    const auto state = mCorrector.state();
+    auto output = mCorrector.track(input);
+
+    // set tempo if host /
+    //   timeline has changed it
+    if (output.setTempo)
+    {
+        sessionState.setTempo(hostBpm, hostTime);
+    }
+    if (output.requestBeat)
+    {
+        sessionState.requestBeatAtTime(
+            output.requestedBeat, hostTime, output.requestQuantum
+        );
+    }
+
+    // sync
+    input.adjustedBeat = sessionState.beatAtTime(hostTime, quantum);
+    input.linkPhase =
+        sessionState.phaseAtTime(hostTime, 4. / input.timesigDenom);
+    // in real-time mode the sync loop runs once per audio block
+    input.blockTime = numSamples / g_abuf_srate.load();
+    input.frameTime = fromAudioThread ? input.blockTime : mFrameTime.load();
+    input.outputLatency = outputLatency();
+    mCorrector.setServo(mServo, mServoBandwidth, mServoMaxDeviation);
+    mCorrector.correct(input, output);
+    g_timeline_offset_reablink = output.diff;
+
+    for (int i = 0; i < output.commandCount; ++i)
+    {
+        issueCommand(output.command, fromAudioThread);
+    }
+    if (output.setPlayrate)
+    {
+        issuePlayrate(output.playrate, fromAudioThread);
+    }
+    if (output.forceBeat)
+    {
+        sessionState.forceBeatAtTime(output.forcedBeat, hostTime, quantum);
+    }
+
+    mTrace.record(TraceRecord{input, state, output});
 }
 
 // NOLINTEND(*complexity)
-} // namespace reablink
\ No newline at end of file
+} // namespace reablink
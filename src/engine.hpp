@@ -1,8 +1,21 @@
 #ifndef REABLINK_ENGINE_HPP
 #define REABLINK_ENGINE_HPP
 
+#include "ClockDriftEstimator.hpp"
+#include "EventRing.hpp"
+#include "Histogram.hpp"
+#include "LockFreeQueue.hpp"
+#include "PlayCursor.hpp"
+#include "RollingAverage.hpp"
+#include "SeqLock.hpp"
+#include "calibration.hpp"
+#include "metronome.hpp"
+#include "midi_clock.hpp"
+#include "phase_corrector.hpp"
+#include "project_cache.hpp"
+#include "trace.hpp"
 #include <ableton/Link.hpp>
-#include <mutex>
+#include <optional>
 
 namespace reablink
 {
@@ -11,6 +24,41 @@ using namespace ableton;
 class AudioEngine
 {
 public:
+  // profiled phases, durations and intervals in nanoseconds
+  enum class Stat
+  {
+    TickInterval,    // between timer ticks
+    Tick,            // whole timer tick
+    Capture,         // session state capture
+    TimeMap,         // project tempo/time signature lookups
+    Correction,      // sync loop in a timer tick
+    Commit,          // session state commit
+    Block,           // whole real-time audio block sync
+    BlockCorrection, // sync loop in a real-time audio block
+    Count
+  };
+
+  // Link session as of the last timer tick or API commit
+  struct Snapshot
+  {
+    std::optional<Link::SessionState> sessionState; // empty if not synced
+    std::size_t numPeers{0};
+  };
+
+  // Link session change reported by a Link callback
+  struct Event
+  {
+    enum class Type
+    {
+      Tempo = 1,
+      NumPeers,
+      Playing,
+    };
+    Type type;
+    double value;
+    std::chrono::microseconds time; // Link clock when reported
+  };
+
   AudioEngine(Link& link);
   static void TempoCallback(double bpm);
   void setMaster(bool isMaster);
@@ -26,10 +74,82 @@ public:
   void setQuantum(double quantum);
   bool isStartStopSyncEnabled() const;
   void setStartStopSyncEnabled(bool enabled);
+  void setRealtime(bool isRealtime);
+  bool getRealtime() const;
+  // bandwidth in Hz, playrate stays within 1 +/- maxDeviation
+  void setPlayrateServo(bool enabled, double bandwidth, double maxDeviation);
+  bool getPlayrateServo(double* bandwidth, double* maxDeviation) const;
+  // Puppet playrate cancels the estimated audio clock drift
+  void setClockDriftCompensation(bool enabled);
+  // audio clock against Link clock in ppm, positive when the audio clock
+  // runs fast, 0 until estimated
+  double getClockDrift(bool* compensated) const;
+  // sample time and filtered host time in microseconds of an audio block.
+  // Audio thread, reset when the host time filter restarts. The estimate
+  // is kept unless the sample rate changed.
+  void updateClockDrift(bool reset, double sampleTime, double hostTime,
+                        double srate);
+  // Master tempo changes are committed up to lookahead seconds ahead of
+  // playback, ramps in steps of at least rampStep bpm. Lookahead 0 commits
+  // the current tempo only; negative values keep the current setting.
+  void setTempoLookahead(double lookahead, double rampStep);
+  double getTempoLookahead(double* rampStep) const;
+  // click on the Link grid, mixed into the audio device output
+  void setMetronome(bool enabled, int channel, double volume);
+  bool getMetronome(int* channel, double* volume) const;
+  // MIDI clock on the Link grid, to a REAPER MIDI output device
+  void setMidiClock(bool enabled, int device);
+  bool getMidiClock(int* device) const;
+  // lock-free, for getters that must not wait on Link's session lock
+  Snapshot snapshot() const;
+  // main thread
+  void publishSnapshot(const Link::SessionState& sessionState);
+  void clearSnapshot();
+  // Link callbacks, which Link calls from one thread
+  void postEvent(Event::Type type, double value);
+  // copies up to count events after sequence since, oldest first, and
+  // their sequence numbers. Returns the number copied. Lock-free.
+  int pollEvents(std::uint64_t since,
+                 std::uint64_t* sequences,
+                 Event* events,
+                 int count) const;
+  // Timer tick and real-time block sync. hostTime is when the position
+  // GetPlayPosition2() returns is heard, so both sync the same way.
   void audioCallback(std::chrono::microseconds hostTime,
                      std::size_t numSamples);
+  void audioBlockCallback(std::chrono::microseconds hostTime,
+                          std::size_t numSamples);
   void audioCallback2(std::chrono::microseconds hostTime,
                       std::size_t numSamples);
+  // sends MIDI clock for the block heard from hostTime. Audio thread.
+  void midiClockCallback(std::chrono::microseconds hostTime,
+                         std::size_t numSamples);
+  // adds the metronome to the output block heard from hostTime. Audio
+  // thread, after REAPER processed the block.
+  void metronomeCallback(std::chrono::microseconds hostTime,
+                         std::size_t numSamples,
+                         ReaSample* left,
+                         ReaSample* right);
+  LogHistogram<> getStats(Stat stat) const;
+  void resetStats();
+  // start/stop REAPER runs times to measure its latencies, stored per
+  // audio device. Main thread.
+  bool startCalibration(int runs);
+  void cancelCalibration();
+  // runs left, 0 if not calibrating. Main thread.
+  int getCalibration(LatencyCalibration::Result* result) const;
+  void forgetCalibration();
+  // output latency REAPER compensates for on the current device, recorded
+  // by calibration, else GetOutputLatency as of the last timer tick, so
+  // the audio hook can read it
+  double outputLatency() const;
+  // timer intervals in ms, values below 1 are left as they are
+  void setTickIntervals(int fast, int normal, int idle);
+  // interval until the next timer tick in ms. Main thread.
+  int tickInterval() const;
+  // record sync loop steps to path, stop with empty path. Main thread.
+  bool setTraceFile(const char* path);
+  bool isTracing() const;
 
 private:
   struct EngineData
@@ -38,32 +158,205 @@ private:
     bool requestStart;
     bool requestStop;
     double quantum;
-    bool startStopSyncOn;
   };
 
+  // tempo/start/stop requests from scripts and Link callbacks, drained
+  // by the timer tick
+  struct Request
+  {
+    enum class Type
+    {
+      Tempo,
+      Start,
+      Stop,
+    };
+    Type type;
+    double tempo;
+  };
+
+  // REAPER calls requested by the sync loop which must run on main thread
+  struct Command
+  {
+    enum class Type
+    {
+      MainOnCommand,
+      SetPlayRate,
+    };
+    Type type;
+    int id;
+    double value;
+  };
+
+  // Quantized launch: REAPER is started from the timer tick so that its
+  // next full measure is heard on a Link downbeat, without adding anything
+  // to the project. Main thread only.
+  struct Launch
+  {
+    double targetBeat{0.}; // Link downbeat to land on
+    double targetPos{0.};  // REAPER project time landing on it
+    double startPos{0.};   // where REAPER was started
+    std::chrono::microseconds fireTime{0};
+    double early{0.}; // time left until firing, as of the last tick
+    bool fired{false}; // started, start latency not yet measured
+  };
+
+  // thread running the sync loop, see handOverSync
+  enum class SyncOwner
+  {
+    Timer,
+    Audio,
+    AudioBusy, // inside an audio block
+  };
+
+  // loop range with its beats, recomputed by the timer tick when the range
+  // or the project changes and passed to the sync loop
+  struct LoopRange
+  {
+    bool repeat;
+    double start;
+    double end;
+    double startBeat; // since start of measure
+    double endBeat;
+  };
+
+  // last Master tempo ramp commit. Main thread only.
+  struct TempoRamp
+  {
+    double position{0.}; // REAPER project time heard at the commit
+    double bpm{0.};
+    double behind{0.}; // quarter notes Link was behind REAPER
+  };
+
+  using StatClock = std::chrono::steady_clock;
+
+  void postRequest(Request::Type type, double tempo = 0.);
+  void recordStat(Stat stat, StatClock::time_point since);
   EngineData pullEngineData();
+  // from starting REAPER to hearing it, in seconds
+  double launchLead();
+  void planLaunch(Link::SessionState& sessionState,
+                  std::chrono::microseconds hostTime,
+                  double quantum);
+  void fireLaunch(const Link::SessionState& sessionState,
+                  std::chrono::microseconds hostTime,
+                  double quantum);
+  void measureLaunch(std::chrono::microseconds hostTime);
+  void applyCalibration();
+  // REAPER transport for the real-time sync loop, see PlayCursor
+  PlayCursor playCursor(std::chrono::microseconds hostTime);
+  PlayCursor::Segment tempoSegment(double time);
+  void updateLoopRange(bool projectChanged);
+  // commits upcoming Master tempo changes, returns the tempo to follow
+  double broadcastTempo(Link::SessionState& sessionState,
+                        std::chrono::microseconds hostTime,
+                        double position,
+                        double hostBpm);
+  int predictLoopWraps(double position,
+                       std::chrono::microseconds hostTime,
+                       double playrate);
+  int nextTickInterval(const Link::SessionState& sessionState,
+                       double position,
+                       double tickTime);
+  // main thread, true while the audio thread owns the sync loop
+  bool handOverSync();
+  // audio thread, for the length of a block, false if not its to run
+  bool claimSync();
+  void releaseSync();
+  void syncTimeline(Link::SessionState& sessionState,
+                    std::chrono::microseconds hostTime,
+                    std::size_t numSamples,
+                    double quantum,
+                    double hostBpm,
+                    bool tempoRequested,
+                    bool fromAudioThread);
+  const SessionGrid& audioGrid(std::chrono::microseconds hostTime);
+  void issueCommand(int command, bool fromAudioThread);
+  void issuePlayrate(double playrate, bool fromAudioThread);
+  void runCommands();
+
   Link& mLink; // NOLINT
-  EngineData mSharedEngineData;
-  EngineData mLockfreeEngineData;
-  bool mIsPlaying; // NOLINT
-  std::mutex mEngineDataGuard;
+  MpscQueue<Request, 1024> mRequests;
+  // latest requests that did not fit in a full mailbox
+  std::atomic<double> mOverflowTempo{0.};
+  std::atomic_int mOverflowPlaying{0}; // 1 start, -1 stop
+  std::atomic<double> mQuantum{4.};
+  std::atomic_bool mIsPlaying; // NOLINT
 
   std::atomic_bool isPuppet{false};
   std::atomic_bool isMaster{false};
+  std::atomic_bool isRealtime{false}; // requested
+  std::atomic<SyncOwner> mSyncOwner{SyncOwner::Timer};
+  std::atomic_bool mServo{false};
+  std::atomic<double> mServoBandwidth{SyncParams{}.servoBandwidth};
+  std::atomic<double> mServoMaxDeviation{SyncParams{}.servoMaxDeviation};
+  std::atomic<double> mTempoLookahead{0.025}; // seconds
+  std::atomic<double> mTempoRampStep{0.05};   // bpm
+
+  // shared between main thread tick and audio thread sync loop
+  std::atomic_bool mQuantizedLaunch{false};
+  std::atomic_bool mLaunchPending{false}; // REAPER not started yet
+  std::atomic_bool mResetSync{false};
+  std::atomic_bool mToggle40620{false};
+  std::atomic<double> mFrameTime{0.};
+  std::atomic<double> mOutputLatency{-1.}; // < 0 not calibrated
+  std::atomic_int mTickFast{2};
+  std::atomic_int mTickNormal{12};
+  std::atomic_int mTickIdle{40};
+  std::atomic<double> mSyncQuantum{4.};
+  std::atomic<double> mReaperOutputLatency{0.}; // as of the last tick
+  std::atomic<double> mMasterTempo{0.}; // broadcast by the tick, 0 if none
+  std::atomic<double> mClockDrift{0.};  // ppm
+  std::atomic_bool mDriftCompensation{true};
+  SpscQueue<Command, 256> mCommands;
+  SpscQueue<LoopRange, 16> mLoopUpdates;
+  SpscQueue<PlayCursor, 16> mCursorUpdates; // real-time mode
+  SpscQueue<SessionGrid, 16> mGridUpdates; // timer mode
+  Metronome mMetronome;
+  MidiClock mMidiClock;
+  SeqLock<Snapshot> mSnapshot; // written by main thread
+  EventRing<Event, 256> mEvents;
+  // main thread
+  double mTickBufferTime{0.}; // g_abuf_time when the tick started
+  std::uint64_t mCommandsRun{0};
+  // audio thread
+  PlayCursor mCursor{};
+  std::uint64_t mCommandsIssued{0};
+  double mCommandedPlayrate{1.}; // once the tick ran the issued commands
+
+  // main thread only
+  ProjectCache mProjectCache;
+  Launch mLaunch;
+  LoopRange mLoopRange{};
+  // REAPER transport start latency of recent launches
+  RollingAverage mStartLatency{8};
+  int mStartLatencyCount{0};
+  LatencyCalibration mCalibration;
+  StatClock::time_point mLastTickStart{};
+  double mLastTickTime{0.}; // REAPER clock
+  double mLastTickInterval{0.};
+  double mFastTicksUntil{0.};
+  std::uint64_t mEventsSeen{0};
+  TempoRamp mRamp;
+  int mTickInterval{12};
+
+  // each written by one thread only, the timer tick or the audio thread,
+  // read by scripts
+  std::array<AtomicLogHistogram<>, (size_t)Stat::Count> mStats;
 
   friend class AudioPlatform;
 
   // int playbackFrameCount = 0;
-  double qnAbs = 0.;
-  double qnJumpOffset = 0.;
-  double qnLandOffset = 0.;
-  double diff = 0;
-  double qLen = 0;
-
-  static constexpr auto beatTolerance = 0.02;
-  // static constexpr auto playbackFrameSafe = 16;
-  int syncTolerance = 6;
-  static constexpr auto tempoTolerance = 0.001;
+  // sync loop state, owned by the thread running syncTimeline
+  PhaseCorrector mCorrector;
+  LoopRange mSyncLoop{};
+  double mSyncPrevPosition{0.};
+  std::chrono::microseconds mSyncPrevHostTime{0};
+  // audio thread
+  SessionGrid mAudioGrid{};
+  std::chrono::microseconds mAudioGridTime{0};
+  ClockDriftEstimator<> mDriftEstimator;
+  // written by the sync loop, flushed by the timer tick
+  TraceRecorder mTrace;
 };
 
 class AudioPlatform
@@ -8,4 +8,5 @@ std::atomic<double> g_launch_offset_reablink{};
 std::atomic_int g_abuf_len{};
 std::atomic<double> g_abuf_srate{};
 std::atomic<double> g_abuf_time{};
+std::atomic<double> g_abuf_sample_period{};
 } // namespace reablink
\ No newline at end of file
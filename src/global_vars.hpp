@@ -11,6 +11,7 @@ extern std::atomic<double> g_launch_offset_reablink;
 extern std::atomic_int g_abuf_len;
 extern std::atomic<double> g_abuf_srate;
 extern std::atomic<double> g_abuf_time;
+extern std::atomic<double> g_abuf_sample_period;
 } // namespace reablink
 
 #endif // GLOBAL_VARS_HPP
\ No newline at end of file
@@ -27,45 +27,42 @@ static bool loadAPI(void* (*getFunc)(const char*))
 
   const ApiFunc funcs[]{
     REQUIRED_API(AddProjectMarker),
-    REQUIRED_API(AddProjectMarker2),
     REQUIRED_API(AddRemoveReaScript),
     REQUIRED_API(Audio_RegHardwareHook),
-    REQUIRED_API(CountMediaItems),
     REQUIRED_API(CountProjectMarkers),
-    REQUIRED_API(CreateNewMIDIItemInProj),
-    REQUIRED_API(DeleteProjectMarker),
+    REQUIRED_API(CountTempoTimeSigMarkers),
+    REQUIRED_API(CountTrackMediaItems),
+    REQUIRED_API(CSurf_OnPlayRateChange),
+    REQUIRED_API(DeleteExtState),
     REQUIRED_API(DeleteProjectMarkerByIndex),
     REQUIRED_API(DeleteTempoTimeSigMarker),
     REQUIRED_API(DeleteTrack),
     REQUIRED_API(DeleteTrackMediaItem),
-    REQUIRED_API(EnumProjectMarkers),
     REQUIRED_API(EnumProjectMarkers2),
-    REQUIRED_API(FindTempoTimeSigMarker),
     REQUIRED_API(GetAppVersion),
+    REQUIRED_API(GetAudioDeviceInfo),
     REQUIRED_API(GetCursorPosition),
     REQUIRED_API(GetExtState),
-    REQUIRED_API(GetLastMarkerAndCurRegion),
-    REQUIRED_API(GetMediaItem),
     REQUIRED_API(GetMediaItemInfo_Value),
-    REQUIRED_API(GetMediaItem_Track),
+    REQUIRED_API(GetMidiOutput),
     REQUIRED_API(GetOutputLatency),
     REQUIRED_API(GetPlayPosition),
     REQUIRED_API(GetPlayPosition2),
     REQUIRED_API(GetPlayState),
-    REQUIRED_API(GetProjectLength),
+    REQUIRED_API(GetProjectStateChangeCount),
     REQUIRED_API(GetResourcePath),
     REQUIRED_API(GetSetRepeat),
     REQUIRED_API(GetSet_LoopTimeRange),
     REQUIRED_API(GetTempoTimeSigMarker),
     REQUIRED_API(GetToggleCommandState),
     REQUIRED_API(GetTrack),
-    REQUIRED_API(GoToRegion),
+    REQUIRED_API(GetTrackMediaItem),
     REQUIRED_API(Main_OnCommand),
     REQUIRED_API(Master_GetPlayRate),
     REQUIRED_API(Master_GetTempo),
+    REQUIRED_API(NamedCommandLookup),
     REQUIRED_API(OnPlayButton),
     REQUIRED_API(OnStopButton),
-    REQUIRED_API(PreventUIRefresh),
     REQUIRED_API(SetEditCurPos),
     REQUIRED_API(SetExtState),
     REQUIRED_API(SetTempoTimeSigMarker),
@@ -74,8 +71,6 @@ static bool loadAPI(void* (*getFunc)(const char*))
     REQUIRED_API(TimeMap2_timeToBeats),
     REQUIRED_API(TimeMap2_timeToQN),
     REQUIRED_API(TimeMap_GetTimeSigAtTime),
-    REQUIRED_API(Undo_BeginBlock),
-    REQUIRED_API(Undo_EndBlock),
     REQUIRED_API(UpdateTimeline),
     REQUIRED_API(plugin_register),
     REQUIRED_API(time_precise)
@@ -111,6 +106,11 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(
     reablink::Init(rec);
     return 1;
   }
+  // unloading
+  if (rec == nullptr && plugin_register)
+  {
+    reablink::Unregister();
+  }
 
   return 0;
 }
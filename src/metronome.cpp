@@ -0,0 +1,113 @@
+#include "metronome.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace reablink
+{
+namespace
+{
+constexpr auto pi = 3.14159265358979323846;
+constexpr auto accentFrequency = 1760.; // Hz
+constexpr auto beatFrequency = 880.;
+constexpr auto clickTime = 0.03;  // seconds
+constexpr auto decayTime = 0.006; // envelope time constant, seconds
+// beats at block boundaries are not lost to rounding, nor clicked twice
+constexpr auto beatEpsilon = 1.0e-6;
+} // namespace
+
+void Metronome::set(bool enabled, int channel, double volume)
+{
+  if (channel >= 0)
+  {
+    mChannel = channel;
+  }
+  if (volume >= 0.)
+  {
+    mVolume = std::min(volume, 4.);
+  }
+  mEnabled = enabled;
+}
+
+bool Metronome::get(int* channel, double* volume) const
+{
+  if (channel)
+  {
+    *channel = mChannel;
+  }
+  if (volume)
+  {
+    *volume = mVolume;
+  }
+  return mEnabled;
+}
+
+void Metronome::render(const SessionGrid& grid,
+                       std::chrono::microseconds hostTime,
+                       double samplePeriod,
+                       int numSamples,
+                       ReaSample* left,
+                       ReaSample* right)
+{
+  if (!mEnabled || !left || !(samplePeriod > 0.) || numSamples <= 0)
+  {
+    mRemaining = 0;
+    return;
+  }
+
+  auto from = 0;
+  if (grid.playing && grid.quantum > 0. && grid.tempo > 0.)
+  {
+    const auto beatsPerSample = grid.tempo / 60. * samplePeriod;
+    const auto first = grid.beatAt(hostTime);
+    const auto last = first + numSamples * beatsPerSample - beatEpsilon;
+    const auto begin = std::max(first, grid.beatAt(grid.startTime));
+    for (auto beat = std::ceil(begin - beatEpsilon); beat < last; beat += 1.)
+    {
+      if (beat == mLastBeat)
+      {
+        continue;
+      }
+      const auto sample = (int)std::lround((beat - first) / beatsPerSample);
+      const auto offset = std::clamp(sample, from, numSamples - 1);
+      ring(left, right, from, offset);
+      from = offset;
+      start(beat - grid.quantum * std::floor(beat / grid.quantum) < 0.5,
+            samplePeriod);
+      mLastBeat = beat;
+    }
+  }
+  ring(left, right, from, numSamples);
+}
+
+void Metronome::start(bool accent, double samplePeriod)
+{
+  const auto w =
+    2. * pi * (accent ? accentFrequency : beatFrequency) * samplePeriod;
+  // sin(w n) from n = 0
+  mCoeff = 2. * std::cos(w);
+  mY1 = -std::sin(w);
+  mY2 = -std::sin(2. * w);
+  mEnvelope = mVolume;
+  mDecay = std::exp(-samplePeriod / decayTime);
+  mRemaining = (int)(clickTime / samplePeriod);
+}
+
+void Metronome::ring(ReaSample* left, ReaSample* right, int from, int to)
+{
+  const auto count = std::min(to - from, mRemaining);
+  for (int i = from; i < from + count; ++i)
+  {
+    const auto y = mCoeff * mY1 - mY2;
+    mY2 = mY1;
+    mY1 = y;
+    const auto sample = y * mEnvelope;
+    mEnvelope *= mDecay;
+    left[i] += sample;
+    if (right)
+    {
+      right[i] += sample;
+    }
+  }
+  mRemaining -= std::max(count, 0);
+}
+} // namespace reablink
@@ -0,0 +1,54 @@
+#ifndef REABLINK_METRONOME_HPP
+#define REABLINK_METRONOME_HPP
+
+#include "SessionGrid.hpp"
+#include <atomic>
+#include <chrono>
+
+#include <reaper_plugin.h>
+
+namespace reablink
+{
+// Click on every Link beat, accented on quantum boundaries, mixed into the
+// audio device output by the audio hook. Beats are placed by the Link
+// session timeline, not REAPER's, so the click stays on the Link grid
+// while REAPER is nudged towards it. Clicks are sine bursts from a
+// recursive oscillator; a block without a beat or a ringing click costs a
+// few multiplications. Settings are thread-safe, render() is audio thread
+// only and does not allocate.
+class Metronome
+{
+public:
+  // output channel of the left side, volume is linear
+  void set(bool enabled, int channel, double volume);
+  bool get(int* channel, double* volume) const;
+
+  // adds clicks heard during the block starting at hostTime. Right may be
+  // nullptr for a mono output.
+  void render(const SessionGrid& grid,
+              std::chrono::microseconds hostTime,
+              double samplePeriod, // seconds
+              int numSamples,
+              ReaSample* left,
+              ReaSample* right);
+
+private:
+  void start(bool accent, double samplePeriod);
+  void ring(ReaSample* left, ReaSample* right, int from, int to);
+
+  std::atomic_bool mEnabled{false};
+  std::atomic_int mChannel{0};
+  std::atomic<double> mVolume{0.5};
+
+  // audio thread
+  double mLastBeat{-1.e9};
+  int mRemaining{0}; // samples left of the current click
+  double mCoeff{0.}; // 2 cos(w)
+  double mY1{0.};
+  double mY2{0.};
+  double mEnvelope{0.};
+  double mDecay{0.};
+};
+} // namespace reablink
+
+#endif // REABLINK_METRONOME_HPP
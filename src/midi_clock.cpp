@@ -0,0 +1,144 @@
+#include "midi_clock.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace reablink
+{
+namespace
+{
+constexpr auto ticksPerSixteenth = MidiClock::ppqn / 4.;
+// ticks at block boundaries are not lost to rounding, nor sent twice
+constexpr auto tickEpsilon = 1.0e-6;
+
+constexpr unsigned char clockTick = 0xF8;
+constexpr unsigned char songPosition = 0xF2;
+constexpr unsigned char start = 0xFA;
+constexpr unsigned char resume = 0xFB; // Continue
+constexpr unsigned char stop = 0xFC;
+} // namespace
+
+void MidiClock::set(bool enabled, int device)
+{
+  if (device >= 0)
+  {
+    mDevice = device;
+  }
+  mEnabled = enabled;
+}
+
+bool MidiClock::get(int* device) const
+{
+  if (device)
+  {
+    *device = mDevice;
+  }
+  return mEnabled;
+}
+
+bool MidiClock::active() const
+{
+  return mEnabled || mPlaying;
+}
+
+int MidiClock::render(const SessionGrid& grid,
+                      std::chrono::microseconds hostTime,
+                      double samplePeriod,
+                      int numSamples)
+{
+  mCount = 0;
+  if (!(samplePeriod > 0.) || numSamples <= 0 || !(grid.tempo > 0.))
+  {
+    return 0;
+  }
+
+  const auto ticksPerSample = grid.tempo / 60. * ppqn * samplePeriod;
+  const auto first = grid.beatAt(hostTime) * ppqn;
+  const auto offsetOf = [&](double tick) {
+    return std::clamp((int)std::lround((tick - first) / ticksPerSample), 0,
+                      numSamples - 1);
+  };
+
+  // transport, Stop goes out where the session stopped
+  const auto enabled = mEnabled.load();
+  const auto playing = enabled && grid.playing;
+  auto stopOffset = -1;
+  if (playing && !mPlaying)
+  {
+    const auto from = std::max(grid.beatAt(grid.startTime) * ppqn, first);
+    mStartTick = std::max(
+      std::ceil(from / ticksPerSixteenth - tickEpsilon) * ticksPerSixteenth,
+      0.);
+    mPlaying = true;
+  }
+  else if (!playing && mPlaying)
+  {
+    // nothing to stop if Start has not been sent yet
+    if (mStartTick < 0.)
+    {
+      stopOffset = enabled ? offsetOf(grid.beatAt(grid.startTime) * ppqn) : 0;
+    }
+    mPlaying = false;
+    mStartTick = -1.;
+  }
+  if (!enabled)
+  {
+    if (stopOffset >= 0)
+    {
+      add(stopOffset, 1, stop);
+    }
+    return mCount;
+  }
+
+  const auto last = first + numSamples * ticksPerSample - tickEpsilon;
+  for (auto tick = std::ceil(first - tickEpsilon); tick < last; tick += 1.)
+  {
+    if (tick == mLastTick)
+    {
+      continue;
+    }
+    const auto offset = offsetOf(tick);
+    if (stopOffset >= 0 && stopOffset <= offset)
+    {
+      add(stopOffset, 1, stop);
+      stopOffset = -1;
+    }
+    if (mStartTick >= 0. && tick >= mStartTick)
+    {
+      // song position in sixteenth notes, 14 bits
+      const auto position =
+        (int)std::fmod(mStartTick / ticksPerSixteenth, 16384.);
+      if (position == 0)
+      {
+        add(offset, 1, start);
+      }
+      else
+      {
+        add(offset, 3, songPosition, position & 0x7F, (position >> 7) & 0x7F);
+        add(offset, 1, resume);
+      }
+      mStartTick = -1.;
+    }
+    add(offset, 1, clockTick);
+    mLastTick = tick;
+  }
+  if (stopOffset >= 0)
+  {
+    add(stopOffset, 1, stop);
+  }
+  return mCount;
+}
+
+const MidiClock::Event* MidiClock::events() const
+{
+  return mEvents.data();
+}
+
+void MidiClock::add(int offset, int size, unsigned char status,
+                    unsigned char data1, unsigned char data2)
+{
+  if (mCount < maxEvents)
+  {
+    mEvents[mCount++] = Event{offset, size, {status, data1, data2}};
+  }
+}
+} // namespace reablink
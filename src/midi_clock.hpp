@@ -0,0 +1,62 @@
+#ifndef REABLINK_MIDI_CLOCK_HPP
+#define REABLINK_MIDI_CLOCK_HPP
+
+#include "SessionGrid.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace reablink
+{
+// 24 PPQN MIDI clock on the Link session timeline, with Start, or Song
+// Position Pointer and Continue, when the session starts playing and Stop
+// when it stops. Clock ticks run while stopped too, so receivers know the
+// tempo. Playback starts on the first sixteenth note at or after the Link
+// start, at song position zero or later. Events carry sample offsets into
+// the audio block, so they are not moved by REAPER playrate corrections.
+// Settings are thread-safe, render() is audio thread only and does not
+// allocate.
+class MidiClock
+{
+public:
+  struct Event
+  {
+    int offset; // samples into the block
+    int size;
+    unsigned char message[3];
+  };
+
+  static constexpr int ppqn = 24;
+  static constexpr int maxEvents = 256; // per block
+
+  // REAPER MIDI output device index
+  void set(bool enabled, int device);
+  bool get(int* device) const;
+  // enabled, or Stop still to be sent
+  bool active() const;
+
+  // events heard during the block starting at hostTime, in time order.
+  // Returns the number of events.
+  int render(const SessionGrid& grid,
+             std::chrono::microseconds hostTime,
+             double samplePeriod, // seconds
+             int numSamples);
+  const Event* events() const;
+
+private:
+  void add(int offset, int size, unsigned char status,
+           unsigned char data1 = 0, unsigned char data2 = 0);
+
+  std::atomic_bool mEnabled{false};
+  std::atomic_int mDevice{0};
+
+  // audio thread
+  bool mPlaying{false}; // as sent to the receivers
+  double mStartTick{-1.}; // tick to send Start or Continue with, or < 0
+  double mLastTick{-1.e18};
+  int mCount{0};
+  std::array<Event, maxEvents> mEvents{};
+};
+} // namespace reablink
+
+#endif // REABLINK_MIDI_CLOCK_HPP
@@ -0,0 +1,240 @@
+#include "phase_corrector.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace reablink
+{
+namespace
+{
+constexpr auto pi = 3.14159265358979323846;
+} // namespace
+
+PhaseCorrector::PhaseCorrector(const SyncParams& params)
+  : mParams(params)
+  , mDiffAvg((size_t)std::max(1, params.averageWindow))
+{
+}
+
+SyncOutput PhaseCorrector::track(const SyncInput& input)
+{
+  auto output = SyncOutput{};
+  if (input.flags & SyncInput::Reset)
+  {
+    mQnPrev = 0;
+    mQnJumpOffset = 0;
+    mQnLandOffset = 0;
+  }
+
+  // set tempo if host / timeline has changed it
+  if (input.sessionBeat > 0. && input.hostBpm != input.sessionTempo &&
+      !(input.flags & SyncInput::TempoRequested))
+  {
+    output.setTempo = 1;
+  }
+
+  // loop wraps are predicted from the loop range and elapsed time, so
+  // short loops and early wraps are not missed and the phase offsets are
+  // in place on the step landing after the wrap
+  if (input.loopWraps > 0)
+  {
+    const auto wraps = (double)input.loopWraps;
+    mQnJumpOffset = std::fmod(mQnJumpOffset + wraps * input.loopEndBeat, 1.0);
+    mQnLandOffset =
+      std::fmod(mQnLandOffset + wraps * input.loopStartBeat, 1.0);
+  }
+  // other jumps, detected after the fact
+  else if (std::abs(input.qn - mQnPrev) > mParams.jumpThreshold &&
+           input.sessionBeat > mParams.minJumpBeat)
+  {
+    if (input.flags & SyncInput::Repeat)
+    {
+      if (input.flags & SyncInput::InLoop)
+      {
+        mQnJumpOffset = std::fmod(mQnJumpOffset + input.loopEndBeat, 1.0);
+        mQnLandOffset = std::fmod(mQnLandOffset + input.loopStartBeat, 1.0);
+      }
+    }
+    else
+    {
+      output.requestBeat = 1;
+      output.requestedBeat = std::fmod(input.beat, 1.);
+      output.requestQuantum = 4. / input.timesigDenom;
+    }
+  }
+  mQnPrev = input.qn;
+  return output;
+}
+
+void PhaseCorrector::correct(const SyncInput& input, SyncOutput& output)
+{
+  const auto tempo = output.setTempo ? input.hostBpm : input.sessionTempo;
+  const auto reaperPhase =
+    std::fmod(input.beat - mQnLandOffset + mQnJumpOffset, 1.0);
+  // integer ratio, phase is not scaled for denominators below 4
+  const auto linkPhase = input.linkPhase * (input.timesigDenom / 4);
+  // REAPER ahead of Link is positive. Wrapped to half a beat either way,
+  // so a beat boundary between the two does not count as a whole beat.
+  auto phaseDiff = reaperPhase - std::fmod(linkPhase, 1.0);
+  phaseDiff -= std::round(phaseDiff);
+
+  const auto phaseDiffTime = phaseDiff * 60. / tempo;
+  mDiffAvg.add(phaseDiffTime);
+  const auto diff = mDiffAvg.average();
+
+  auto limitDenom = mParams.limitDivisor;
+  if (input.outputLatency / input.blockTime > mParams.lowLatencyRatio)
+  {
+    limitDenom = mParams.lowLatencyDivisor;
+  }
+  const auto limit =
+    std::max(input.frameTime / limitDenom, input.outputLatency / limitDenom);
+  if (!(mLimit > 0.))
+  {
+    mLimit = limit; // seconds
+  }
+
+  const auto isMaster = (input.flags & SyncInput::Master) != 0;
+  const auto isPuppet = (input.flags & SyncInput::Puppet) != 0;
+  const auto base = input.basePlayrate;
+  const auto correctable =
+    !isMaster && isPuppet && input.numPeers > 0 &&
+    !(input.flags & SyncInput::QuantizedLaunch) &&
+    (input.adjustedBeat < 0 || input.adjustedBeat > mParams.launchGuardBeat) &&
+    std::abs(phaseDiff) < mParams.maxPhaseDiff &&
+    !(input.flags & SyncInput::Toggle40620);
+  if (mParams.servo && !isMaster && isPuppet && input.numPeers > 0)
+  {
+    servo(input, output, diff, correctable);
+  }
+  else if (correctable && std::abs(diff) > mLimit)
+  {
+    mLimit = limit * mParams.correctionScale;
+    if (phaseDiff > 0. && input.playrate >= base)
+    {
+      output.command = 40525;
+      output.commandCount = mParams.correctionSteps;
+    }
+    else if (phaseDiff < 0. && input.playrate <= base)
+    {
+      output.command = 40524;
+      output.commandCount = mParams.correctionSteps;
+    }
+  }
+  // Compensated drift leaves the difference it had accumulated before the
+  // estimate was ready, which may be anywhere inside the tolerance
+  else if (correctable && base != 1. &&
+           std::abs(input.playrate - base) <= 1.0e-6 &&
+           std::abs(diff) > mParams.trimTime)
+  {
+    output.setPlayrate = 1;
+    output.playrate =
+      base * (diff > 0. ? 1. - mParams.trimRate : 1. + mParams.trimRate);
+  }
+  // A correction holds its playrate until the latest phase difference is
+  // within the settle time or past it, the average lags behind and would
+  // stop it anywhere inside the tolerance
+  else if (!isMaster && isPuppet && input.numPeers > 0 &&
+           std::abs(diff) < mLimit &&
+           (base == 1. ? input.playrate != 1.
+                       : std::abs(input.playrate - base) > 1.0e-6) &&
+           (input.playrate < base ? phaseDiffTime < mParams.settleTime
+                                  : phaseDiffTime > -mParams.settleTime))
+  {
+    mLimit = limit;
+    if (base == 1.)
+    {
+      output.command = 40521;
+      output.commandCount = 1;
+    }
+    else
+    {
+      output.setPlayrate = 1;
+      output.playrate = base;
+    }
+  }
+  else if ((input.numPeers == 0 || isMaster) && std::abs(diff) > mLimit)
+  {
+    output.forceBeat = 1;
+    output.forcedBeat = input.qn;
+  }
+
+  output.diff = diff;
+  output.limit = mLimit;
+}
+
+// Type 2 loop: REAPER phase integrates playrate - 1, so a PI controller
+// with Kp = 2 zeta wn and Ki = wn^2 gives a second order response with
+// natural frequency wn. Integration stops while the playrate is clamped.
+// The base playrate feeds audio clock drift forward, so the integral does
+// not have to carry it.
+void PhaseCorrector::servo(const SyncInput& input, SyncOutput& output,
+                           double diff, bool correct)
+{
+  const auto dt =
+    mLastHostTime == 0
+      ? 0.
+      : std::clamp((input.hostTime - mLastHostTime) / 1.0e6, 0., 0.1);
+  mLastHostTime = input.hostTime;
+
+  const auto base = input.basePlayrate;
+  auto playrate = base;
+  if (correct)
+  {
+    const auto wn = 2. * pi * mParams.servoBandwidth;
+    const auto kp = 2. * mParams.servoDamping * wn;
+    const auto ki = wn * wn;
+    const auto integral = mIntegral + diff * dt;
+    const auto unclamped = base - kp * diff - ki * integral;
+    playrate = std::clamp(unclamped, base - mParams.servoMaxDeviation,
+                          base + mParams.servoMaxDeviation);
+    if (playrate == unclamped)
+    {
+      mIntegral = integral;
+    }
+  }
+  else
+  {
+    mIntegral = 0.;
+  }
+
+  // no REAPER call for changes too small to matter
+  if (std::abs(playrate - input.playrate) > 1.0e-5)
+  {
+    output.setPlayrate = 1;
+    output.playrate = playrate;
+  }
+}
+
+PhaseCorrector::State PhaseCorrector::state() const
+{
+  return State{mQnPrev,       mQnJumpOffset, mQnLandOffset,
+               mLimit,        mIntegral,     mLastHostTime};
+}
+
+void PhaseCorrector::setState(const State& state)
+{
+  mQnPrev = state.qnPrev;
+  mQnJumpOffset = state.qnJumpOffset;
+  mQnLandOffset = state.qnLandOffset;
+  mLimit = state.limit;
+  mIntegral = state.integral;
+  mLastHostTime = state.lastHostTime;
+}
+
+const SyncParams& PhaseCorrector::params() const
+{
+  return mParams;
+}
+
+void PhaseCorrector::setServo(bool enabled, double bandwidth,
+                              double maxDeviation)
+{
+  if (!enabled)
+  {
+    mIntegral = 0.;
+  }
+  mParams.servo = enabled;
+  mParams.servoBandwidth = bandwidth;
+  mParams.servoMaxDeviation = maxDeviation;
+}
+} // namespace reablink
@@ -0,0 +1,133 @@
+#ifndef REABLINK_PHASE_CORRECTOR_HPP
+#define REABLINK_PHASE_CORRECTOR_HPP
+
+#include "RollingAverage.hpp"
+#include <cstdint>
+
+namespace reablink
+{
+// Tuning constants of the sync loop
+struct SyncParams
+{
+  double jumpThreshold{0.5};     // qn step treated as a loop or seek
+  double minJumpBeat{1.};        // no jump handling before this beat
+  double launchGuardBeat{1.666}; // no playrate correction before this beat
+  double maxPhaseDiff{0.5};      // wider phase differences are left alone
+  double limitDivisor{8.};       // tolerance is frame or buffer time over this
+  double lowLatencyDivisor{1.};  // ...or this with output latency of more
+  double lowLatencyRatio{3.};    //    than this many blocks
+  double correctionScale{0.5};   // tolerance while correcting
+  double settleTime{0.0001};     // a correction ends this close, seconds
+  double trimTime{0.0005};       // with drift compensation, trim from here
+  double trimRate{0.001};        // ...at this fraction off the base playrate
+  int averageWindow{8};          // phase difference average, in steps
+  int correctionSteps{2};        // playrate actions per correction
+  // continuous playrate from a PI controller instead of playrate actions
+  bool servo{false};
+  double servoBandwidth{0.5};     // loop natural frequency, Hz
+  double servoDamping{0.707};
+  double servoMaxDeviation{0.02}; // playrate clamped to 1 +/- this
+};
+
+// One sync loop step. Session values are sampled at hostTime, before the
+// step's own session changes unless noted otherwise.
+struct SyncInput
+{
+  enum Flags : uint32_t
+  {
+    Master = 1 << 0,
+    Puppet = 1 << 1,
+    QuantizedLaunch = 1 << 2,
+    Toggle40620 = 1 << 3,
+    TempoRequested = 1 << 4,
+    Reset = 1 << 5,
+    Repeat = 1 << 6,
+    InLoop = 1 << 7, // play position inside the loop range
+    FromAudioThread = 1 << 8,
+  };
+
+  int64_t hostTime; // microseconds
+  uint32_t flags;
+  int32_t numPeers;
+  double sessionTempo;
+  double sessionBeat;
+  double hostBpm;
+  double position;
+  double qn;
+  double beat; // since start of measure
+  int32_t timesigNum;
+  int32_t timesigDenom;
+  double loopStartBeat; // valid with Repeat
+  double loopEndBeat;
+  int32_t loopWraps; // since the previous step, predicted by the engine
+  double playrate;
+  double basePlayrate; // cancels audio clock drift, 1 without
+  double frameTime;
+  double outputLatency;
+  double blockTime;
+  // after the tempo and beat requests in SyncOutput were applied
+  double adjustedBeat;
+  double linkPhase; // at quantum of one time signature denominator
+};
+
+struct SyncOutput
+{
+  double diff;  // averaged REAPER minus Link phase, seconds
+  double limit; // tolerance after this step, seconds
+  int32_t command; // REAPER action, 0 if none
+  int32_t commandCount;
+  uint8_t setTempo; // session tempo to hostBpm
+  uint8_t requestBeat;
+  uint8_t forceBeat;
+  uint8_t setPlayrate;
+  double requestedBeat; // at quantum requestQuantum
+  double requestQuantum;
+  double forcedBeat; // at the sync quantum
+  double playrate;   // with setPlayrate
+};
+
+// Phase and playrate decisions of the sync loop, without REAPER or Link
+// calls, so recorded inputs can be replayed offline. A step is split in
+// two because the adjusted session values depend on the first half:
+// track() decides session tempo and jump handling, correct() compares
+// phases and picks a playrate action, servo playrate or forced beat.
+class PhaseCorrector
+{
+public:
+  explicit PhaseCorrector(const SyncParams& params = SyncParams{});
+
+  SyncOutput track(const SyncInput& input);
+  void correct(const SyncInput& input, SyncOutput& output);
+
+  // loop state carried between steps, for seeding a replay
+  struct State
+  {
+    double qnPrev;
+    double qnJumpOffset;
+    double qnLandOffset;
+    double limit;
+    double integral;
+    int64_t lastHostTime;
+  };
+
+  State state() const;
+  void setState(const State& state);
+  const SyncParams& params() const;
+  void setServo(bool enabled, double bandwidth, double maxDeviation);
+
+private:
+  void servo(const SyncInput& input, SyncOutput& output, double diff,
+             bool correct);
+
+  SyncParams mParams;
+  double mQnPrev{0.};
+  double mQnJumpOffset{0.};
+  double mQnLandOffset{0.};
+  double mLimit{0.};
+  double mIntegral{0.}; // servo phase error integral, seconds^2
+  int64_t mLastHostTime{0};
+  RollingAverage mDiffAvg;
+};
+} // namespace reablink
+
+#endif // REABLINK_PHASE_CORRECTOR_HPP
@@ -0,0 +1,200 @@
+#include "project_cache.hpp"
+#include <algorithm>
+#include <cmath>
+
+#include <reaper_plugin_functions.h>
+
+namespace reablink
+{
+bool ProjectCache::update()
+{
+  const auto changeCount = GetProjectStateChangeCount(0);
+  if (mValid && changeCount == mChangeCount)
+  {
+    return false;
+  }
+  rebuild();
+  mChangeCount = changeCount;
+  mValid = true;
+  return true;
+}
+
+void ProjectCache::invalidate()
+{
+  mValid = false;
+}
+
+void ProjectCache::rebuild()
+{
+  mTempoMap.clear();
+  const auto tempoCount = CountTempoTimeSigMarkers(0);
+  mTempoMap.reserve(tempoCount);
+  for (int i = 0; i < tempoCount; ++i)
+  {
+    auto marker = TempoMarker{};
+    if (!GetTempoTimeSigMarker(0, i, &marker.time, 0, 0, &marker.bpm, 0, 0,
+                               &marker.linear))
+    {
+      break;
+    }
+    marker.qn = TimeMap2_timeToQN(0, marker.time);
+    marker.beat = TimeMap2_timeToBeats(0, marker.time, &marker.measure,
+                                       &marker.num, 0, &marker.denom);
+    mTempoMap.push_back(marker);
+  }
+
+  mMarkers.clear();
+  mMarkerIds.clear();
+  mRegionIds.clear();
+  const auto markerCount = CountProjectMarkers(0, 0, 0);
+  mMarkers.reserve(markerCount);
+  for (int i = 0; i < markerCount; ++i)
+  {
+    bool isRegion{false};
+    double pos{0};
+    double end{0};
+    const char* name{nullptr};
+    int id{0};
+    if (!EnumProjectMarkers2(0, i, &isRegion, &pos, &end, &name, &id))
+    {
+      break;
+    }
+    mMarkers.push_back(Marker{i, id, isRegion, pos, end, name ? name : ""});
+    (isRegion ? mRegionIds : mMarkerIds).emplace_back(id, i);
+  }
+  std::sort(mMarkerIds.begin(), mMarkerIds.end());
+  std::sort(mRegionIds.begin(), mRegionIds.end());
+}
+
+int ProjectCache::tempoMarkerAt(double time) const
+{
+  const auto it = std::upper_bound(
+    mTempoMap.begin(), mTempoMap.end(), time,
+    [](double t, const TempoMarker& marker) { return t < marker.time; });
+  return (int)(it - mTempoMap.begin()) - 1;
+}
+
+int ProjectCache::tempoMarkerAtPosition(double time) const
+{
+  const auto it = std::lower_bound(
+    mTempoMap.begin(), mTempoMap.end(), time,
+    [](const TempoMarker& marker, double t) { return marker.time < t; });
+  if (it == mTempoMap.end() || it->time != time)
+  {
+    return -1;
+  }
+  return (int)(it - mTempoMap.begin());
+}
+
+const ProjectCache::TempoMarker* ProjectCache::tempoMarker(int idx) const
+{
+  if (idx < 0 || idx >= (int)mTempoMap.size())
+  {
+    return nullptr;
+  }
+  return &mTempoMap[idx];
+}
+
+const ProjectCache::TempoMarker* ProjectCache::squareSegmentAt(
+  double time) const
+{
+  const auto idx = tempoMarkerAt(time);
+  if (idx < 0)
+  {
+    return nullptr;
+  }
+  const auto& marker = mTempoMap[idx];
+  // a linear marker ramps towards the next one
+  if (marker.linear && idx + 1 < (int)mTempoMap.size())
+  {
+    return nullptr;
+  }
+  return &marker;
+}
+
+void ProjectCache::timeSigAt(double time, int* num, int* denom,
+                             double* bpm) const
+{
+  const auto* marker = squareSegmentAt(time);
+  if (!marker)
+  {
+    TimeMap_GetTimeSigAtTime(0, time, num, denom, bpm);
+    return;
+  }
+  if (num)
+    *num = marker->num;
+  if (denom)
+    *denom = marker->denom;
+  if (bpm)
+    *bpm = marker->bpm;
+}
+
+double ProjectCache::timeToQN(double time) const
+{
+  const auto* marker = squareSegmentAt(time);
+  if (!marker)
+  {
+    return TimeMap2_timeToQN(0, time);
+  }
+  return marker->qn + (time - marker->time) * marker->bpm / 60.;
+}
+
+double ProjectCache::timeToBeats(double time, int* measures, int* num,
+                                 int* denom) const
+{
+  const auto* marker = squareSegmentAt(time);
+  if (!marker || marker->num <= 0)
+  {
+    return TimeMap2_timeToBeats(0, time, measures, num, 0, denom);
+  }
+  const auto beats = marker->beat + (timeToQN(time) - marker->qn) *
+                                      marker->denom / 4.;
+  const auto elapsed = std::floor(beats / marker->num);
+  if (measures)
+    *measures = marker->measure + (int)elapsed;
+  if (num)
+    *num = marker->num;
+  if (denom)
+    *denom = marker->denom;
+  return beats - elapsed * marker->num;
+}
+
+double ProjectCache::beatsToTime(double beat, int measure) const
+{
+  // last tempo marker at or before the beat
+  const auto it = std::upper_bound(
+    mTempoMap.begin(), mTempoMap.end(), std::make_pair(measure, beat),
+    [](const std::pair<int, double>& target, const TempoMarker& marker) {
+      return target < std::make_pair(marker.measure, marker.beat);
+    });
+  const auto idx = (int)(it - mTempoMap.begin()) - 1;
+  const auto* marker = tempoMarker(idx);
+  if (!marker || marker->num <= 0 || marker->bpm <= 0. ||
+      (marker->linear && idx + 1 < (int)mTempoMap.size()))
+  {
+    return TimeMap2_beatsToTime(0, beat, &measure);
+  }
+  const auto beats =
+    (measure - marker->measure) * marker->num + beat - marker->beat;
+  const auto qn = beats * 4. / marker->denom;
+  return marker->time + qn * 60. / marker->bpm;
+}
+
+const ProjectCache::Marker* ProjectCache::findMarker(int id,
+                                                     bool isRegion) const
+{
+  const auto& ids = isRegion ? mRegionIds : mMarkerIds;
+  const auto it = std::lower_bound(ids.begin(), ids.end(),
+                                   std::make_pair(id, -1));
+  if (it == ids.end() || it->first != id)
+  {
+    return nullptr;
+  }
+  return &mMarkers[it->second];
+}
+
+const std::vector<ProjectCache::Marker>& ProjectCache::markers() const
+{
+  return mMarkers;
+}
+} // namespace reablink
@@ -0,0 +1,78 @@
+#ifndef REABLINK_PROJECT_CACHE_HPP
+#define REABLINK_PROJECT_CACHE_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace reablink
+{
+// Sorted snapshot of the project tempo/time signature map and the marker
+// and region table. Rebuilt when the project state change count moves, so
+// timer tick lookups are binary searches instead of REAPER API calls.
+// Linear tempo ramps and positions before the first tempo marker are
+// passed through to REAPER. Main thread only.
+class ProjectCache
+{
+public:
+  struct TempoMarker
+  {
+    double time;
+    double qn;
+    double bpm;
+    double beat; // since start of measure, in time signature denominator
+    int measure;
+    int num; // time signature in effect from this marker
+    int denom;
+    bool linear;
+  };
+
+  struct Marker
+  {
+    int idx; // enumeration index
+    int id;  // displayed marker/region number
+    bool isRegion;
+    double pos;
+    double end;
+    std::string name;
+  };
+
+  // rebuild if the project changed since the last call
+  bool update();
+  // rebuild on next update(), for edits not yet counted by REAPER
+  void invalidate();
+
+  // tempo marker at or before time, -1 if none
+  int tempoMarkerAt(double time) const;
+  // tempo marker exactly at time, -1 if none
+  int tempoMarkerAtPosition(double time) const;
+  const TempoMarker* tempoMarker(int idx) const;
+
+  // same results as TimeMap_GetTimeSigAtTime, TimeMap2_timeToQN and
+  // TimeMap2_timeToBeats
+  void timeSigAt(double time, int* num, int* denom, double* bpm) const;
+  double timeToQN(double time) const;
+  double timeToBeats(double time, int* measures, int* num, int* denom) const;
+  // same result as TimeMap2_beatsToTime, beat counted from the start of
+  // measure
+  double beatsToTime(double beat, int measure) const;
+
+  const Marker* findMarker(int id, bool isRegion) const;
+  // enumeration order, which is position order
+  const std::vector<Marker>& markers() const;
+
+private:
+  void rebuild();
+  // tempo marker starting a square tempo segment holding time, or nullptr
+  const TempoMarker* squareSegmentAt(double time) const;
+
+  int mChangeCount{0};
+  bool mValid{false};
+  std::vector<TempoMarker> mTempoMap;
+  std::vector<Marker> mMarkers;
+  std::vector<std::pair<int, int>> mMarkerIds; // (id, idx), sorted
+  std::vector<std::pair<int, int>> mRegionIds;
+};
+} // namespace reablink
+
+#endif // REABLINK_PROJECT_CACHE_HPP
@@ -0,0 +1,89 @@
+#include "tick_thread.hpp"
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#include <timeapi.h>
+#endif
+
+namespace reablink
+{
+TickThread::~TickThread()
+{
+  stop();
+}
+
+void TickThread::start(HWND window, int command, int intervalMs)
+{
+  if (mRunning || command == 0)
+  {
+    return;
+  }
+  mWindow = window;
+  mCommand = command;
+  mIntervalMs = intervalMs;
+  mPosted = false;
+  mRunning = true;
+  mThread = std::thread(&TickThread::run, this);
+}
+
+void TickThread::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRunning = false;
+  }
+  mWake.notify_one();
+  if (mThread.joinable())
+  {
+    mThread.join();
+  }
+}
+
+bool TickThread::running() const
+{
+  return mRunning;
+}
+
+bool TickThread::handle(int command)
+{
+  if (command != mCommand || !mRunning)
+  {
+    return false;
+  }
+  mPosted = false;
+  return true;
+}
+
+void TickThread::setInterval(int intervalMs)
+{
+  mIntervalMs = intervalMs;
+}
+
+void TickThread::run()
+{
+#ifdef _WIN32
+  // default scheduler resolution is about 16 ms
+  timeBeginPeriod(1);
+#endif
+  auto next = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (mRunning)
+  {
+    // a busy main thread delays ticks, they are not caught up
+    next = std::max(next + std::chrono::milliseconds(mIntervalMs.load()),
+                    std::chrono::steady_clock::now());
+    if (mWake.wait_until(lock, next, [this] { return !mRunning; }))
+    {
+      break;
+    }
+    if (!mPosted.exchange(true))
+    {
+      PostMessage(mWindow, WM_COMMAND, mCommand, 0);
+    }
+  }
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+}
+} // namespace reablink
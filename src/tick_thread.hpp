@@ -0,0 +1,43 @@
+#ifndef REABLINK_TICK_THREAD_HPP
+#define REABLINK_TICK_THREAD_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <reaper_plugin.h>
+
+namespace reablink
+{
+// Times the sync loop ticks on its own thread and posts each one to REAPER's
+// main window as WM_COMMAND with a registered command id, so the tick runs on
+// the main thread. Window timers on Windows do not go below 10 ms. A tick is
+// not posted again until the main thread handled the previous one.
+class TickThread
+{
+public:
+  ~TickThread();
+  void start(HWND window, int command, int intervalMs);
+  void stop();
+  bool running() const;
+  // main thread, from the command hook. True if command is the tick.
+  bool handle(int command);
+  // time from the last tick to the next one, in ms
+  void setInterval(int intervalMs);
+
+private:
+  void run();
+
+  std::thread mThread;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::atomic_bool mRunning{false};
+  std::atomic_bool mPosted{false};
+  std::atomic_int mIntervalMs{12};
+  HWND mWindow{nullptr};
+  int mCommand{0};
+};
+} // namespace reablink
+
+#endif
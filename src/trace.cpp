@@ -0,0 +1,243 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <string>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace reablink
+{
+namespace
+{
+constexpr char traceMagic[8] = {'R', 'B', 'L', 'T', 'R', 'A', 'C', 'E'};
+
+#ifdef _WIN32
+std::wstring widen(const char* path)
+{
+  const auto size = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+  std::wstring result(size > 0 ? size : 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path, -1, &result[0], size);
+  return result;
+}
+#endif
+} // namespace
+
+TraceRecorder::~TraceRecorder()
+{
+  close();
+}
+
+bool TraceRecorder::open(const char* path, uint64_t capacity)
+{
+  close();
+  if (!path || !*path || capacity == 0)
+  {
+    return false;
+  }
+  if (!map(path, sizeof(TraceHeader) + capacity * sizeof(TraceRecord)))
+  {
+    return false;
+  }
+  std::memcpy(mHeader->magic, traceMagic, sizeof(traceMagic));
+  mHeader->version = version;
+  mHeader->recordSize = sizeof(TraceRecord);
+  mHeader->capacity = capacity;
+  mHeader->written = 0;
+  mHeader->dropped = 0;
+
+  // the ring outlives every trace, the sync loop may still hold it
+  if (!mRing)
+  {
+    mRing = std::make_unique<Ring>();
+  }
+  auto stale = TraceRecord{};
+  while (mRing->pop(stale))
+  {
+  }
+  mDropped.store(0, std::memory_order_relaxed);
+  mEnabled.store(true, std::memory_order_release);
+  return true;
+}
+
+void TraceRecorder::close()
+{
+  if (!mHeader)
+  {
+    return;
+  }
+  mEnabled.store(false, std::memory_order_release);
+  flush();
+  unmap();
+}
+
+void TraceRecorder::flush()
+{
+  if (!mHeader || !mRing)
+  {
+    return;
+  }
+  auto record = TraceRecord{};
+  auto written = mHeader->written;
+  while (mRing->pop(record))
+  {
+    mRecords[written % mHeader->capacity] = record;
+    ++written;
+  }
+  mHeader->dropped = mDropped.load(std::memory_order_relaxed);
+  // readers take records below the count
+  std::atomic_thread_fence(std::memory_order_release);
+  mHeader->written = written;
+}
+
+bool TraceRecorder::isOpen() const
+{
+  return mEnabled.load(std::memory_order_acquire);
+}
+
+void TraceRecorder::record(const TraceRecord& record)
+{
+  if (!mEnabled.load(std::memory_order_acquire))
+  {
+    return;
+  }
+  if (!mRing->push(record))
+  {
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+#ifdef _WIN32
+bool TraceRecorder::map(const char* path, size_t size)
+{
+  const auto file =
+    CreateFileW(widen(path).c_str(), GENERIC_READ | GENERIC_WRITE,
+                FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  const auto mapping =
+    CreateFileMappingW(file, nullptr, PAGE_READWRITE,
+                       (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  auto* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+  if (!view)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  mFile = file;
+  mMapping = mapping;
+  mMapSize = size;
+  mHeader = static_cast<TraceHeader*>(view);
+  mRecords = reinterpret_cast<TraceRecord*>(mHeader + 1);
+  return true;
+}
+
+void TraceRecorder::unmap()
+{
+  FlushViewOfFile(mHeader, 0);
+  UnmapViewOfFile(mHeader);
+  CloseHandle(mMapping);
+  CloseHandle(mFile);
+  mHeader = nullptr;
+  mRecords = nullptr;
+  mMapSize = 0;
+  mMapping = nullptr;
+  mFile = nullptr;
+}
+#else
+bool TraceRecorder::map(const char* path, size_t size)
+{
+  const auto file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file < 0)
+  {
+    return false;
+  }
+  if (ftruncate(file, (off_t)size) != 0)
+  {
+    ::close(file);
+    return false;
+  }
+  auto* view =
+    mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  if (view == MAP_FAILED)
+  {
+    ::close(file);
+    return false;
+  }
+  mFile = file;
+  mMapSize = size;
+  mHeader = static_cast<TraceHeader*>(view);
+  mRecords = reinterpret_cast<TraceRecord*>(mHeader + 1);
+  return true;
+}
+
+void TraceRecorder::unmap()
+{
+  msync(mHeader, mMapSize, MS_ASYNC);
+  munmap(mHeader, mMapSize);
+  ::close(mFile);
+  mHeader = nullptr;
+  mRecords = nullptr;
+  mMapSize = 0;
+  mFile = -1;
+}
+#endif
+
+bool ReadTrace(const char* path, std::vector<TraceRecord>& records,
+               TraceHeader* header)
+{
+  auto* file = fopen(path, "rb");
+  if (!file)
+  {
+    return false;
+  }
+  auto head = TraceHeader{};
+  const auto valid =
+    fread(&head, sizeof(head), 1, file) == 1 &&
+    std::memcmp(head.magic, traceMagic, sizeof(traceMagic)) == 0 &&
+    head.version == TraceRecorder::version &&
+    head.recordSize == sizeof(TraceRecord) && head.capacity > 0;
+  if (!valid)
+  {
+    fclose(file);
+    return false;
+  }
+  std::vector<TraceRecord> ring(
+    (size_t)std::min<uint64_t>(head.written, head.capacity));
+  const auto read = fread(ring.data(), sizeof(TraceRecord), ring.size(), file);
+  fclose(file);
+  if (read != ring.size())
+  {
+    return false;
+  }
+
+  // unroll the ring, oldest first
+  records.clear();
+  records.reserve(ring.size());
+  const auto first = head.written - ring.size();
+  for (auto i = first; i < head.written; ++i)
+  {
+    records.push_back(ring[(size_t)(i % head.capacity)]);
+  }
+  if (header)
+  {
+    *header = head;
+  }
+  return true;
+}
+} // namespace reablink
@@ -0,0 +1,84 @@
+#ifndef REABLINK_TRACE_HPP
+#define REABLINK_TRACE_HPP
+
+#include "LockFreeQueue.hpp"
+#include "phase_corrector.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace reablink
+{
+// One sync loop step, as seen and decided by the engine
+struct TraceRecord
+{
+  SyncInput input;
+  PhaseCorrector::State state; // before the step
+  SyncOutput output;
+};
+
+// Trace file layout: this header, then a ring of capacity records. Record
+// i of the session is at slot i % capacity and the oldest one kept is
+// written - capacity. Records are in native layout, so traces are read by
+// tools built from the same sources.
+struct TraceHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t capacity;
+  uint64_t written;
+  uint64_t dropped; // lost to a full in-memory ring
+};
+
+// Opt-in recorder for sync loop steps. The sync loop pushes records into a
+// preallocated in-memory ring without blocking or allocating; the main
+// thread copies them into a memory-mapped file, so touching file pages
+// never stalls the audio thread and the trace survives a crash of REAPER.
+class TraceRecorder
+{
+public:
+  static constexpr uint32_t version = 4;
+  static constexpr uint64_t defaultCapacity = 1 << 18; // 64 MB
+
+  TraceRecorder() = default;
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+  ~TraceRecorder();
+
+  // main thread, replaces an open trace
+  bool open(const char* path, uint64_t capacity = defaultCapacity);
+  void close();
+  void flush();
+
+  bool isOpen() const;
+  // sync loop thread, drops the record if the ring is full
+  void record(const TraceRecord& record);
+
+private:
+  using Ring = SpscQueue<TraceRecord, 4096>;
+
+  bool map(const char* path, size_t size);
+  void unmap();
+
+  std::unique_ptr<Ring> mRing;
+  std::atomic_bool mEnabled{false};
+  std::atomic<uint64_t> mDropped{0};
+  TraceHeader* mHeader{nullptr};
+  TraceRecord* mRecords{nullptr};
+  size_t mMapSize{0};
+#ifdef _WIN32
+  void* mFile{nullptr};
+  void* mMapping{nullptr};
+#else
+  int mFile{-1};
+#endif
+};
+
+// whole trace in session order, false if path is not a trace
+bool ReadTrace(const char* path, std::vector<TraceRecord>& records,
+               TraceHeader* header = nullptr);
+} // namespace reablink
+
+#endif // REABLINK_TRACE_HPP
@@ -0,0 +1,124 @@
+// Compares RollingAverage with the previous copy-and-sort implementation.
+#include "RollingAverage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <numeric>
+#include <random>
+
+namespace
+{
+// previous implementation, kept verbatim for reference
+class SortingRollingAverage
+{
+  std::deque<double> values;
+  size_t maxSize;
+
+public:
+  SortingRollingAverage(size_t size) : maxSize(size)
+  {
+  }
+
+  void add(double value)
+  {
+    if (values.size() == maxSize)
+    {
+      values.pop_front();
+    }
+    values.push_back(value);
+  }
+
+  double average() const
+  {
+    if (values.empty())
+    {
+      return 0.0;
+    }
+
+    std::deque<double> sortedValues = values;
+    std::sort(sortedValues.begin(), sortedValues.end());
+
+    size_t quarter = sortedValues.size() / 4;
+    double sum = std::accumulate(sortedValues.begin() + quarter,
+                                 sortedValues.end() - quarter, 0.0);
+    return sum / (sortedValues.size() - 2 * quarter);
+  }
+};
+
+template <typename Average>
+double run(Average& avg, const std::vector<double>& input, double& checksum)
+{
+  const auto start = std::chrono::steady_clock::now();
+  for (auto value : input)
+  {
+    avg.add(value);
+    checksum += avg.average();
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         input.size();
+}
+} // namespace
+
+int main()
+{
+  std::mt19937 rng(42);
+  // frame times around 12 ms with jitter and occasional stalls
+  std::normal_distribution<double> jitter(0.012, 0.002);
+  std::bernoulli_distribution stall(0.01);
+  // both sum the same values, in a different order
+  constexpr double tolerance = 1.0e-9;
+  auto failed = false;
+
+  printf("%8s %12s %12s %10s %12s\n", "window", "sort ns/op", "tree ns/op",
+         "speedup", "max |delta|");
+  for (size_t window : {8, 512, 4096})
+  {
+    const size_t ops = std::max<size_t>(2000, 4000000 / window);
+    std::vector<double> input(window + ops);
+    for (auto& value : input)
+    {
+      value = jitter(rng) + (stall(rng) ? 0.05 : 0.);
+    }
+
+    // equivalence on the full sequence
+    SortingRollingAverage sorting(window);
+    RollingAverage tree(window);
+    double maxDelta = 0.;
+    for (size_t i = 0; i < std::min<size_t>(input.size(), 20000); ++i)
+    {
+      sorting.add(input[i]);
+      tree.add(input[i]);
+      maxDelta =
+        std::max(maxDelta, std::fabs(sorting.average() - tree.average()));
+    }
+
+    // timing with a full window
+    const std::vector<double> warmup(input.begin(), input.begin() + window);
+    const std::vector<double> timed(input.begin() + window, input.end());
+    SortingRollingAverage sortingTimed(window);
+    RollingAverage treeTimed(window);
+    double checksum = 0.;
+    run(sortingTimed, warmup, checksum);
+    run(treeTimed, warmup, checksum);
+    const auto sortNs = run(sortingTimed, timed, checksum);
+    const auto treeNs = run(treeTimed, timed, checksum);
+
+    printf("%8zu %12.1f %12.1f %9.1fx %12.3g\n", window, sortNs, treeNs,
+           sortNs / treeNs, maxDelta);
+    if (std::isnan(checksum))
+    {
+      return 1;
+    }
+    if (!(maxDelta <= tolerance))
+    {
+      fprintf(stderr, "window %zu: average differs from reference by %g\n",
+              window, maxDelta);
+      failed = true;
+    }
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+// Offline replay of a sync loop trace recorded with Blink_SetTraceFile.
+// Every recorded step is fed through the phase corrector twice, once with
+// default tuning as a check against the recording and once with the given
+// overrides, and the decisions are compared. Replay is open loop: REAPER
+// positions and session values are taken from the trace, so the report
+// shows where a tuning would have decided differently, not how REAPER
+// would then have moved. Prints a JSON report.
+//
+// usage: reablink_replay TRACE [--set name=value]... [--csv FILE]
+#include "phase_corrector.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace reablink;
+
+namespace
+{
+struct Param
+{
+  const char* name;
+  double SyncParams::*real;
+  int SyncParams::*integer;
+  bool SyncParams::*flag;
+};
+
+const Param params[]{
+  {"jumpThreshold", &SyncParams::jumpThreshold, nullptr, nullptr},
+  {"minJumpBeat", &SyncParams::minJumpBeat, nullptr, nullptr},
+  {"launchGuardBeat", &SyncParams::launchGuardBeat, nullptr, nullptr},
+  {"maxPhaseDiff", &SyncParams::maxPhaseDiff, nullptr, nullptr},
+  {"limitDivisor", &SyncParams::limitDivisor, nullptr, nullptr},
+  {"lowLatencyDivisor", &SyncParams::lowLatencyDivisor, nullptr, nullptr},
+  {"lowLatencyRatio", &SyncParams::lowLatencyRatio, nullptr, nullptr},
+  {"correctionScale", &SyncParams::correctionScale, nullptr, nullptr},
+  {"settleTime", &SyncParams::settleTime, nullptr, nullptr},
+  {"trimTime", &SyncParams::trimTime, nullptr, nullptr},
+  {"trimRate", &SyncParams::trimRate, nullptr, nullptr},
+  {"averageWindow", nullptr, &SyncParams::averageWindow, nullptr},
+  {"correctionSteps", nullptr, &SyncParams::correctionSteps, nullptr},
+  {"servo", nullptr, nullptr, &SyncParams::servo},
+  {"servoBandwidth", &SyncParams::servoBandwidth, nullptr, nullptr},
+  {"servoDamping", &SyncParams::servoDamping, nullptr, nullptr},
+  {"servoMaxDeviation", &SyncParams::servoMaxDeviation, nullptr, nullptr},
+};
+
+struct Options
+{
+  std::string trace;
+  std::string csv;
+  SyncParams params;
+};
+
+[[noreturn]] void usage()
+{
+  fprintf(stderr, "usage: reablink_replay TRACE [--set name=value]... "
+                  "[--csv FILE]\nparameters:");
+  for (const auto& param : params)
+    fprintf(stderr, " %s", param.name);
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+Options parse(int argc, char** argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    if ((arg == "--set" || arg == "--csv") && i + 1 >= argc)
+      usage();
+    if (arg == "--csv")
+    {
+      opt.csv = argv[++i];
+    }
+    else if (arg == "--set")
+    {
+      const std::string assignment = argv[++i];
+      const auto eq = assignment.find('=');
+      const auto name = assignment.substr(0, eq);
+      const auto* param = [&]() -> const Param* {
+        for (const auto& p : params)
+          if (name == p.name)
+            return &p;
+        return nullptr;
+      }();
+      if (eq == std::string::npos || !param)
+        usage();
+      const auto value = atof(assignment.c_str() + eq + 1);
+      if (param->real)
+        opt.params.*param->real = value;
+      else if (param->integer)
+        opt.params.*param->integer = (int)value;
+      else
+        opt.params.*param->flag = value != 0.;
+    }
+    else if (opt.trace.empty() && arg[0] != '-')
+    {
+      opt.trace = arg;
+    }
+    else
+    {
+      usage();
+    }
+  }
+  if (opt.trace.empty())
+    usage();
+  return opt;
+}
+
+struct Summary
+{
+  int slowDown{0}; // playrate actions
+  int speedUp{0};
+  int resets{0};
+  int forcedBeats{0};
+  int beatRequests{0};
+  int tempoPushes{0};
+  int playrateChanges{0}; // servo
+  double sumSquares{0.};
+  double maxDiff{0.};
+  size_t steps{0};
+  // against the recorded decisions
+  size_t differences{0};
+  long firstDifference{-1};
+
+  void add(const SyncOutput& output)
+  {
+    const auto actions = output.commandCount;
+    playrateChanges += output.setPlayrate;
+    if (output.command == 40525)
+      slowDown += actions;
+    else if (output.command == 40524)
+      speedUp += actions;
+    else if (output.command == 40521)
+      resets += actions;
+    forcedBeats += output.forceBeat;
+    beatRequests += output.requestBeat;
+    tempoPushes += output.setTempo;
+    sumSquares += output.diff * output.diff;
+    maxDiff = std::max(maxDiff, std::fabs(output.diff));
+    ++steps;
+  }
+
+  void compare(size_t step, const SyncOutput& output,
+               const SyncOutput& recorded)
+  {
+    if (output.command == recorded.command &&
+        output.commandCount == recorded.commandCount &&
+        output.forceBeat == recorded.forceBeat &&
+        output.requestBeat == recorded.requestBeat &&
+        output.setTempo == recorded.setTempo &&
+        output.setPlayrate == recorded.setPlayrate &&
+        output.playrate == recorded.playrate)
+      return;
+    if (firstDifference < 0)
+      firstDifference = (long)step;
+    ++differences;
+  }
+
+  void print(const char* name, bool last) const
+  {
+    printf("  \"%s\": {\n", name);
+    printf("    \"slow_down_actions\": %d,\n", slowDown);
+    printf("    \"speed_up_actions\": %d,\n", speedUp);
+    printf("    \"playrate_resets\": %d,\n", resets);
+    printf("    \"forced_beats\": %d,\n", forcedBeats);
+    printf("    \"beat_requests\": %d,\n", beatRequests);
+    printf("    \"tempo_pushes\": %d,\n", tempoPushes);
+    printf("    \"playrate_changes\": %d,\n", playrateChanges);
+    printf("    \"diff_rms_ms\": %.6f,\n",
+           steps ? std::sqrt(sumSquares / steps) * 1000. : 0.);
+    printf("    \"diff_max_ms\": %.6f,\n", maxDiff * 1000.);
+    printf("    \"differences\": %zu,\n", differences);
+    printf("    \"first_difference\": %ld\n", firstDifference);
+    printf("  }%s\n", last ? "" : ",");
+  }
+};
+
+SyncOutput replay(PhaseCorrector& corrector, const TraceRecord& record)
+{
+  auto output = corrector.track(record.input);
+  corrector.correct(record.input, output);
+  return output;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const auto opt = parse(argc, argv);
+
+  std::vector<TraceRecord> records;
+  auto header = TraceHeader{};
+  if (!ReadTrace(opt.trace.c_str(), records, &header))
+  {
+    fprintf(stderr, "%s: not a trace of this build\n", opt.trace.c_str());
+    return 1;
+  }
+
+  FILE* csv = nullptr;
+  if (!opt.csv.empty())
+  {
+    csv = fopen(opt.csv.c_str(), "w");
+    if (!csv)
+    {
+      fprintf(stderr, "%s: cannot write\n", opt.csv.c_str());
+      return 1;
+    }
+    fprintf(csv, "time_s,peers,qn,playrate,recorded_diff_ms,recorded_command,"
+                 "candidate_diff_ms,candidate_command\n");
+  }
+
+  // the phase difference average is not in the trace, so decisions are
+  // compared once it has refilled
+  PhaseCorrector baseline;
+  PhaseCorrector candidate(opt.params);
+  Summary recorded;
+  Summary baselineSummary;
+  Summary candidateSummary;
+  const auto warmup = (size_t)std::max(SyncParams{}.averageWindow,
+                                       opt.params.averageWindow);
+  const auto t0 = records.empty() ? 0 : records.front().input.hostTime;
+  for (size_t i = 0; i < records.size(); ++i)
+  {
+    const auto& record = records[i];
+    if (i == 0)
+    {
+      baseline.setState(record.state);
+      candidate.setState(record.state);
+    }
+    const auto a = replay(baseline, record);
+    const auto b = replay(candidate, record);
+    recorded.add(record.output);
+    baselineSummary.add(a);
+    candidateSummary.add(b);
+    if (i >= warmup)
+    {
+      baselineSummary.compare(i, a, record.output);
+      candidateSummary.compare(i, b, record.output);
+    }
+    if (csv)
+    {
+      fprintf(csv, "%.6f,%d,%.6f,%.6f,%.6f,%d,%.6f,%d\n",
+              (record.input.hostTime - t0) / 1.0e6, record.input.numPeers,
+              record.input.qn, record.input.playrate,
+              record.output.diff * 1000.,
+              record.output.command * record.output.commandCount,
+              b.diff * 1000., b.command * b.commandCount);
+    }
+  }
+  if (csv)
+    fclose(csv);
+
+  printf("{\n");
+  printf("  \"records\": %zu,\n", records.size());
+  printf("  \"written\": %llu,\n", (unsigned long long)header.written);
+  printf("  \"dropped\": %llu,\n", (unsigned long long)header.dropped);
+  printf("  \"duration_s\": %.6f,\n",
+         records.empty() ? 0.
+                         : (records.back().input.hostTime - t0) / 1.0e6);
+  printf("  \"params\": {\n");
+  for (size_t i = 0; i < std::size(params); ++i)
+  {
+    const auto& param = params[i];
+    const auto value = param.real      ? opt.params.*param.real
+                       : param.integer ? opt.params.*param.integer
+                                       : opt.params.*param.flag;
+    printf("    \"%s\": %g%s\n", param.name, value,
+           i + 1 < std::size(params) ? "," : "");
+  }
+  printf("  },\n");
+  recorded.print("recorded", false);
+  baselineSummary.print("baseline", false);
+  candidateSummary.print("candidate", true);
+  printf("}\n");
+
+  // baseline must reproduce the recording, otherwise the corrector
+  // changed since the trace was taken
+  return baselineSummary.differences ? 2 : 0;
+}
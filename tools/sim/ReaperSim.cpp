@@ -0,0 +1,821 @@
+#include "ReaperSim.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#define REAPERAPI_IMPLEMENT
+#include <reaper_plugin_functions.h>
+
+namespace reablink::sim
+{
+namespace
+{
+ReaperSim& S()
+{
+  return ReaperSim::get();
+}
+
+// opaque handle for the single track items are created on
+char g_track{};
+
+void sortMarkers()
+{
+  std::stable_sort(S().markers.begin(), S().markers.end(),
+                   [](const auto& a, const auto& b) { return a.pos < b.pos; });
+}
+
+void sortTempoMap()
+{
+  std::stable_sort(S().tempoMap.begin(), S().tempoMap.end(),
+                   [](const auto& a, const auto& b) { return a.pos < b.pos; });
+}
+
+int nextMarkerId(bool isRegion)
+{
+  int id = 0;
+  for (const auto& marker : S().markers)
+  {
+    if (marker.isRegion == isRegion)
+    {
+      id = std::max(id, marker.id);
+    }
+  }
+  return id + 1;
+}
+
+const ReaperSim::TempoMarker& timeSigAt(double time)
+{
+  const auto idx = S().tempoMarkerAt(time);
+  return S().tempoMap[std::max(idx, 0)];
+}
+
+// beats in time signature denominator units since project start
+double fullBeatsAtTime(double time)
+{
+  const auto& grid = S().tempoMap.front();
+  return S().qnAtTime(time) * grid.denom / 4.;
+}
+
+// REAPER API stand-ins
+
+int SimAddProjectMarker2(ReaProject*, bool isrgn, double pos, double rgnend,
+                         const char* name, int wantidx, int)
+{
+  const auto id = wantidx >= 0 ? wantidx : nextMarkerId(isrgn);
+  S().markers.push_back({isrgn, pos, isrgn ? rgnend : pos, name ? name : "",
+                         id});
+  sortMarkers();
+  ++S().changeCount;
+  return id;
+}
+
+int SimAddProjectMarker(ReaProject* proj, bool isrgn, double pos,
+                        double rgnend, const char* name, int wantidx)
+{
+  return SimAddProjectMarker2(proj, isrgn, pos, rgnend, name, wantidx, 0);
+}
+
+int SimCountProjectMarkers(ReaProject*, int* num_markersOut,
+                           int* num_regionsOut)
+{
+  int regions = 0;
+  for (const auto& marker : S().markers)
+  {
+    regions += marker.isRegion ? 1 : 0;
+  }
+  if (num_markersOut)
+    *num_markersOut = (int)S().markers.size() - regions;
+  if (num_regionsOut)
+    *num_regionsOut = regions;
+  return (int)S().markers.size();
+}
+
+int SimEnumProjectMarkers2(ReaProject*, int idx, bool* isrgnOut,
+                           double* posOut, double* rgnendOut,
+                           const char** nameOut, int* markrgnindexnumberOut)
+{
+  if (idx < 0 || idx >= (int)S().markers.size())
+    return 0;
+  const auto& marker = S().markers[idx];
+  if (isrgnOut)
+    *isrgnOut = marker.isRegion;
+  if (posOut)
+    *posOut = marker.pos;
+  if (rgnendOut)
+    *rgnendOut = marker.end;
+  if (nameOut)
+    *nameOut = marker.name.c_str();
+  if (markrgnindexnumberOut)
+    *markrgnindexnumberOut = marker.id;
+  return idx + 1;
+}
+
+int SimEnumProjectMarkers(int idx, bool* isrgnOut, double* posOut,
+                          double* rgnendOut, const char** nameOut,
+                          int* markrgnindexnumberOut)
+{
+  return SimEnumProjectMarkers2(nullptr, idx, isrgnOut, posOut, rgnendOut,
+                                nameOut, markrgnindexnumberOut);
+}
+
+bool SimDeleteProjectMarkerByIndex(ReaProject*, int idx)
+{
+  if (idx < 0 || idx >= (int)S().markers.size())
+    return false;
+  S().markers.erase(S().markers.begin() + idx);
+  ++S().changeCount;
+  return true;
+}
+
+bool SimDeleteProjectMarker(ReaProject*, int markrgnindexnumber, bool isrgn)
+{
+  auto& markers = S().markers;
+  const auto it =
+    std::find_if(markers.begin(), markers.end(), [&](const auto& marker) {
+      return marker.id == markrgnindexnumber && marker.isRegion == isrgn;
+    });
+  if (it == markers.end())
+    return false;
+  markers.erase(it);
+  ++S().changeCount;
+  return true;
+}
+
+void SimGetLastMarkerAndCurRegion(ReaProject*, double time, int* markeridxOut,
+                                  int* regionidxOut)
+{
+  int last = -1;
+  for (int i = 0; i < (int)S().markers.size(); ++i)
+  {
+    const auto& marker = S().markers[i];
+    if (!marker.isRegion && marker.pos <= time)
+      last = i;
+  }
+  if (markeridxOut)
+    *markeridxOut = last;
+  if (regionidxOut)
+    *regionidxOut = S().regionAt(time);
+}
+
+void SimGoToRegion(ReaProject*, int region_index, bool)
+{
+  S().pendingRegion = region_index;
+}
+
+int SimFindTempoTimeSigMarker(ReaProject*, double time)
+{
+  return S().tempoMarkerAt(time);
+}
+
+int SimCountTempoTimeSigMarkers(ReaProject*)
+{
+  return (int)S().tempoMap.size();
+}
+
+bool SimGetTempoTimeSigMarker(ReaProject*, int ptidx, double* timeposOut,
+                              int* measureposOut, double* beatposOut,
+                              double* bpmOut, int* timesig_numOut,
+                              int* timesig_denomOut, bool* lineartempoOut)
+{
+  if (ptidx < 0 || ptidx >= (int)S().tempoMap.size())
+    return false;
+  const auto& marker = S().tempoMap[ptidx];
+  const auto& grid = S().tempoMap.front();
+  const auto fullBeats = fullBeatsAtTime(marker.pos);
+  const auto measure = std::floor(fullBeats / grid.num);
+  if (timeposOut)
+    *timeposOut = marker.pos;
+  if (measureposOut)
+    *measureposOut = (int)measure;
+  if (beatposOut)
+    *beatposOut = fullBeats - measure * grid.num;
+  if (bpmOut)
+    *bpmOut = marker.bpm;
+  if (timesig_numOut)
+    *timesig_numOut = marker.num;
+  if (timesig_denomOut)
+    *timesig_denomOut = marker.denom;
+  if (lineartempoOut)
+    *lineartempoOut = marker.linear;
+  return true;
+}
+
+bool SimSetTempoTimeSigMarker(ReaProject*, int ptidx, double timepos, int,
+                              double, double bpm, int timesig_num,
+                              int timesig_denom, bool lineartempo)
+{
+  auto& map = S().tempoMap;
+  const auto num = timesig_num > 0 ? timesig_num : timeSigAt(timepos).num;
+  const auto denom =
+    timesig_denom > 0 ? timesig_denom : timeSigAt(timepos).denom;
+  if (ptidx < 0)
+  {
+    map.push_back({timepos, bpm, num, denom, lineartempo});
+  }
+  else if (ptidx < (int)map.size())
+  {
+    map[ptidx] = {timepos, bpm, num, denom, lineartempo};
+  }
+  else
+  {
+    return false;
+  }
+  sortTempoMap();
+  ++S().changeCount;
+  return true;
+}
+
+bool SimDeleteTempoTimeSigMarker(ReaProject*, int markerindex)
+{
+  auto& map = S().tempoMap;
+  // keep at least one marker so the map stays defined
+  if (markerindex < 0 || markerindex >= (int)map.size() || map.size() == 1)
+    return false;
+  map.erase(map.begin() + markerindex);
+  ++S().changeCount;
+  return true;
+}
+
+void SimTimeMap_GetTimeSigAtTime(ReaProject*, double time,
+                                 int* timesig_numOut, int* timesig_denomOut,
+                                 double* tempoOut)
+{
+  const auto& marker = timeSigAt(time);
+  if (timesig_numOut)
+    *timesig_numOut = marker.num;
+  if (timesig_denomOut)
+    *timesig_denomOut = marker.denom;
+  if (tempoOut)
+    *tempoOut = S().bpmAtTime(time);
+}
+
+double SimTimeMap2_timeToBeats(ReaProject*, double tpos,
+                               int* measuresOutOptional,
+                               int* cmlOutOptional,
+                               double* fullbeatsOutOptional,
+                               int* cdenomOutOptional)
+{
+  const auto& grid = S().tempoMap.front();
+  const auto fullBeats = fullBeatsAtTime(tpos);
+  const auto measure = std::floor(fullBeats / grid.num);
+  if (measuresOutOptional)
+    *measuresOutOptional = (int)measure;
+  if (cmlOutOptional)
+    *cmlOutOptional = grid.num;
+  if (fullbeatsOutOptional)
+    *fullbeatsOutOptional = fullBeats;
+  if (cdenomOutOptional)
+    *cdenomOutOptional = grid.denom;
+  return fullBeats - measure * grid.num;
+}
+
+double SimTimeMap2_beatsToTime(ReaProject*, double tpos,
+                               const int* measuresInOptional)
+{
+  const auto& grid = S().tempoMap.front();
+  auto fullBeats = tpos;
+  if (measuresInOptional)
+    fullBeats += *measuresInOptional * grid.num;
+  return S().timeAtQN(fullBeats * 4. / grid.denom);
+}
+
+double SimTimeMap2_timeToQN(ReaProject*, double tpos)
+{
+  return S().qnAtTime(tpos);
+}
+
+double SimTimeMap2_QNToTime(ReaProject*, double qn)
+{
+  return S().timeAtQN(qn);
+}
+
+double SimMaster_GetTempo()
+{
+  return S().tempoMap.front().bpm;
+}
+
+int SimCountMediaItems(ReaProject*)
+{
+  return (int)S().items.size();
+}
+
+MediaItem* SimGetMediaItem(ReaProject*, int itemidx)
+{
+  if (itemidx < 0 || itemidx >= (int)S().items.size())
+    return nullptr;
+  return reinterpret_cast<MediaItem*>(S().items[itemidx].get());
+}
+
+double SimGetMediaItemInfo_Value(MediaItem* item, const char* parmname)
+{
+  if (!item || !parmname)
+    return 0.;
+  const auto* simItem = reinterpret_cast<const ReaperSim::Item*>(item);
+  if (!strcmp(parmname, "D_POSITION"))
+    return simItem->pos;
+  if (!strcmp(parmname, "D_LENGTH"))
+    return simItem->end - simItem->pos;
+  return 0.;
+}
+
+MediaTrack* SimGetMediaItem_Track(MediaItem* item)
+{
+  return item ? reinterpret_cast<MediaTrack*>(&g_track) : nullptr;
+}
+
+MediaTrack* SimGetTrack(ReaProject*, int trackidx)
+{
+  return trackidx == 0 ? reinterpret_cast<MediaTrack*>(&g_track) : nullptr;
+}
+
+// all items are on the single track, in position order like REAPER's
+int SimCountTrackMediaItems(MediaTrack* track)
+{
+  return track ? (int)S().items.size() : 0;
+}
+
+MediaItem* SimGetTrackMediaItem(MediaTrack* track, int itemidx)
+{
+  return track ? SimGetMediaItem(nullptr, itemidx) : nullptr;
+}
+
+MediaItem* SimCreateNewMIDIItemInProj(MediaTrack* track, double starttime,
+                                      double endtime, const bool*)
+{
+  if (!track)
+    return nullptr;
+  auto& items = S().items;
+  const auto at = std::upper_bound(items.begin(), items.end(), starttime,
+                                   [](double t, const auto& item) {
+                                     return t < item->pos;
+                                   });
+  const auto it = items.insert(
+    at,
+    std::make_unique<ReaperSim::Item>(ReaperSim::Item{0, starttime, endtime}));
+  ++S().changeCount;
+  return reinterpret_cast<MediaItem*>(it->get());
+}
+
+bool SimDeleteTrackMediaItem(MediaTrack*, MediaItem* item)
+{
+  auto& items = S().items;
+  const auto it = std::find_if(items.begin(), items.end(), [&](const auto& p) {
+    return reinterpret_cast<MediaItem*>(p.get()) == item;
+  });
+  if (it == items.end())
+    return false;
+  items.erase(it);
+  ++S().changeCount;
+  return true;
+}
+
+bool SimValidatePtr2(ReaProject*, void* pointer, const char* ctypename)
+{
+  if (!pointer || !ctypename)
+    return false;
+  if (!strcmp(ctypename, "MediaItem*"))
+  {
+    for (const auto& item : S().items)
+    {
+      if (item.get() == pointer)
+        return true;
+    }
+    return false;
+  }
+  return pointer == &g_track;
+}
+
+double SimGetProjectLength(ReaProject*)
+{
+  return S().projectLength();
+}
+
+int SimGetProjectStateChangeCount(ReaProject*)
+{
+  return S().changeCount;
+}
+
+double SimGetCursorPosition()
+{
+  return S().cursor;
+}
+
+void SimSetEditCurPos(double time, bool, bool seekplay)
+{
+  S().cursor = std::max(0., time);
+  if (seekplay && S().playing)
+  {
+    S().position = S().cursor;
+    ++S().seeks;
+  }
+}
+
+int SimGetPlayState()
+{
+  return S().playing ? 1 : 0;
+}
+
+double SimGetPlayPosition2()
+{
+  return S().playing ? S().position : S().cursor;
+}
+
+double SimGetPlayPosition()
+{
+  if (!S().playing)
+    return S().cursor;
+  return S().position - S().outputLatency * S().playrate;
+}
+
+void SimOnPlayButton()
+{
+  S().play();
+}
+
+void SimOnStopButton()
+{
+  S().stop();
+}
+
+void SimMain_OnCommand(int command, int)
+{
+  auto& sim = S();
+  switch (command)
+  {
+  case 40524:
+    sim.playrate = std::min(4., sim.playrate * sim.playrateStep);
+    ++sim.playrateCommands;
+    break;
+  case 40525:
+    sim.playrate = std::max(0.25, sim.playrate / sim.playrateStep);
+    ++sim.playrateCommands;
+    break;
+  case 40521:
+    sim.playrate = 1.;
+    ++sim.playrateCommands;
+    break;
+  default:
+    break;
+  }
+}
+
+void SimCSurf_OnPlayRateChange(double playrate)
+{
+  S().playrate = std::clamp(playrate, 0.25, 4.);
+  ++S().playrateCommands;
+}
+
+double SimMaster_GetPlayRate(ReaProject*)
+{
+  return S().playrate;
+}
+
+int SimGetSetRepeat(int val)
+{
+  if (val == 0 || val == 1)
+    S().repeat = val == 1;
+  else if (val > 1)
+    S().repeat = !S().repeat;
+  return S().repeat ? 1 : 0;
+}
+
+void SimGetSet_LoopTimeRange(bool isSet, bool, double* startOut,
+                             double* endOut, bool)
+{
+  if (isSet)
+  {
+    S().loopStart = startOut ? *startOut : 0.;
+    S().loopEnd = endOut ? *endOut : 0.;
+    return;
+  }
+  if (startOut)
+    *startOut = S().loopStart;
+  if (endOut)
+    *endOut = S().loopEnd;
+}
+
+int SimGetToggleCommandState(int)
+{
+  return 0;
+}
+
+class SimMidiOutput : public midi_Output
+{
+public:
+  void SendMsg(MIDI_event_t* msg, int frame_offset) override
+  {
+    auto event = ReaperSim::MidiEvent{frame_offset, msg->size, {}};
+    std::copy_n(msg->midi_message, std::min(msg->size, 4), event.message);
+    S().midiOut.push_back(event);
+  }
+  void Send(unsigned char status, unsigned char d1, unsigned char d2,
+            int frame_offset) override
+  {
+    S().midiOut.push_back({frame_offset, 3, {status, d1, d2, 0}});
+  }
+};
+
+midi_Output* SimGetMidiOutput(int)
+{
+  static SimMidiOutput output;
+  return &output;
+}
+
+double SimGetOutputLatency()
+{
+  return S().outputLatency;
+}
+
+double SimTime_precise()
+{
+  return S().now;
+}
+
+void SimPreventUIRefresh(int)
+{
+}
+
+void SimUndo_BeginBlock()
+{
+}
+
+void SimUndo_EndBlock(const char*, int)
+{
+}
+
+void SimUpdateTimeline()
+{
+}
+
+void SimShowConsoleMsg(const char* msg)
+{
+  fputs(msg, stderr);
+}
+
+bool SimGetAudioDeviceInfo(const char* attribute, char* desc, int desc_sz)
+{
+  if (strcmp(attribute, "IDENT_OUT") != 0 || desc_sz < 1)
+    return false;
+  snprintf(desc, desc_sz, "%s", S().device.c_str());
+  return true;
+}
+
+const char* SimGetExtState(const char* section, const char* key)
+{
+  const auto it = S().extState.find(std::string(section) + "/" + key);
+  return it == S().extState.end() ? "" : it->second.c_str();
+}
+
+void SimSetExtState(const char* section, const char* key, const char* value,
+                    bool)
+{
+  S().extState[std::string(section) + "/" + key] = value;
+}
+
+void SimDeleteExtState(const char* section, const char* key, bool)
+{
+  S().extState.erase(std::string(section) + "/" + key);
+}
+} // namespace
+
+ReaperSim& ReaperSim::get()
+{
+  static ReaperSim instance;
+  return instance;
+}
+
+void ReaperSim::install()
+{
+  ::AddProjectMarker = SimAddProjectMarker;
+  ::AddProjectMarker2 = SimAddProjectMarker2;
+  ::CountMediaItems = SimCountMediaItems;
+  ::CountProjectMarkers = SimCountProjectMarkers;
+  ::CountTempoTimeSigMarkers = SimCountTempoTimeSigMarkers;
+  ::CountTrackMediaItems = SimCountTrackMediaItems;
+  ::CreateNewMIDIItemInProj = SimCreateNewMIDIItemInProj;
+  ::CSurf_OnPlayRateChange = SimCSurf_OnPlayRateChange;
+  ::DeleteExtState = SimDeleteExtState;
+  ::DeleteProjectMarker = SimDeleteProjectMarker;
+  ::DeleteProjectMarkerByIndex = SimDeleteProjectMarkerByIndex;
+  ::DeleteTempoTimeSigMarker = SimDeleteTempoTimeSigMarker;
+  ::DeleteTrackMediaItem = SimDeleteTrackMediaItem;
+  ::EnumProjectMarkers = SimEnumProjectMarkers;
+  ::EnumProjectMarkers2 = SimEnumProjectMarkers2;
+  ::FindTempoTimeSigMarker = SimFindTempoTimeSigMarker;
+  ::GetAudioDeviceInfo = SimGetAudioDeviceInfo;
+  ::GetCursorPosition = SimGetCursorPosition;
+  ::GetExtState = SimGetExtState;
+  ::GetLastMarkerAndCurRegion = SimGetLastMarkerAndCurRegion;
+  ::GetMediaItem = SimGetMediaItem;
+  ::GetMediaItemInfo_Value = SimGetMediaItemInfo_Value;
+  ::GetMediaItem_Track = SimGetMediaItem_Track;
+  ::GetMidiOutput = SimGetMidiOutput;
+  ::GetOutputLatency = SimGetOutputLatency;
+  ::GetPlayPosition = SimGetPlayPosition;
+  ::GetPlayPosition2 = SimGetPlayPosition2;
+  ::GetPlayState = SimGetPlayState;
+  ::GetProjectLength = SimGetProjectLength;
+  ::GetProjectStateChangeCount = SimGetProjectStateChangeCount;
+  ::GetSetRepeat = SimGetSetRepeat;
+  ::GetSet_LoopTimeRange = SimGetSet_LoopTimeRange;
+  ::GetTempoTimeSigMarker = SimGetTempoTimeSigMarker;
+  ::GetToggleCommandState = SimGetToggleCommandState;
+  ::GetTrack = SimGetTrack;
+  ::GetTrackMediaItem = SimGetTrackMediaItem;
+  ::GoToRegion = SimGoToRegion;
+  ::Main_OnCommand = SimMain_OnCommand;
+  ::Master_GetPlayRate = SimMaster_GetPlayRate;
+  ::Master_GetTempo = SimMaster_GetTempo;
+  ::OnPlayButton = SimOnPlayButton;
+  ::OnStopButton = SimOnStopButton;
+  ::PreventUIRefresh = SimPreventUIRefresh;
+  ::SetEditCurPos = SimSetEditCurPos;
+  ::SetExtState = SimSetExtState;
+  ::SetTempoTimeSigMarker = SimSetTempoTimeSigMarker;
+  ::ShowConsoleMsg = SimShowConsoleMsg;
+  ::TimeMap2_beatsToTime = SimTimeMap2_beatsToTime;
+  ::TimeMap2_QNToTime = SimTimeMap2_QNToTime;
+  ::TimeMap2_timeToBeats = SimTimeMap2_timeToBeats;
+  ::TimeMap2_timeToQN = SimTimeMap2_timeToQN;
+  ::TimeMap_GetTimeSigAtTime = SimTimeMap_GetTimeSigAtTime;
+  ::Undo_BeginBlock = SimUndo_BeginBlock;
+  ::Undo_EndBlock = SimUndo_EndBlock;
+  ::UpdateTimeline = SimUpdateTimeline;
+  ::ValidatePtr2 = SimValidatePtr2;
+  ::time_precise = SimTime_precise;
+}
+
+void ReaperSim::reset(double bpm, int num, int denom)
+{
+  tempoMap = {{0., bpm, num, denom, false}};
+  markers.clear();
+  items.clear();
+  repeat = false;
+  loopStart = loopEnd = 0.;
+  now = cursor = position = 0.;
+  playrate = 1.;
+  playing = startPending = false;
+  pendingRegion = -1;
+  playrateCommands = seeks = changeCount = 0;
+}
+
+int ReaperSim::tempoMarkerAt(double time) const
+{
+  const auto it =
+    std::upper_bound(tempoMap.begin(), tempoMap.end(), time,
+                     [](double t, const auto& marker) {
+                       return t < marker.pos;
+                     });
+  return (int)(it - tempoMap.begin()) - 1;
+}
+
+int ReaperSim::regionAt(double time) const
+{
+  for (int i = 0; i < (int)markers.size(); ++i)
+  {
+    const auto& marker = markers[i];
+    if (marker.isRegion && marker.pos <= time && time < marker.end)
+      return i;
+  }
+  return -1;
+}
+
+double ReaperSim::bpmAtTime(double time) const
+{
+  const auto idx = std::max(tempoMarkerAt(time), 0);
+  const auto& marker = tempoMap[idx];
+  if (!marker.linear || idx + 1 >= (int)tempoMap.size() || time < marker.pos)
+    return marker.bpm;
+  const auto& next = tempoMap[idx + 1];
+  const auto fraction = (time - marker.pos) / (next.pos - marker.pos);
+  return marker.bpm + (next.bpm - marker.bpm) * fraction;
+}
+
+double ReaperSim::qnAtTime(double time) const
+{
+  if (time < 0.)
+    return time * tempoMap.front().bpm / 60.;
+  // segments start at 0 and at each marker, ramps integrate as trapezoids
+  double qn = 0.;
+  double from = 0.;
+  for (size_t i = 0; i <= tempoMap.size(); ++i)
+  {
+    const auto to =
+      i < tempoMap.size() ? std::min(tempoMap[i].pos, time) : time;
+    if (to > from)
+    {
+      qn += (to - from) * (bpmAtTime(from) + bpmAtTime(to - 1.0e-12)) / 120.;
+      from = to;
+    }
+    if (from >= time)
+      break;
+  }
+  return qn;
+}
+
+double ReaperSim::timeAtQN(double qn) const
+{
+  if (qn < 0.)
+    return qn * 60. / tempoMap.front().bpm;
+  double from = 0.;
+  double fromQN = 0.;
+  for (size_t i = 0; i < tempoMap.size(); ++i)
+  {
+    const auto to = tempoMap[i].pos;
+    if (to <= from)
+      continue;
+    const auto toQN = qnAtTime(to);
+    if (toQN >= qn)
+      break;
+    from = to;
+    fromQN = toQN;
+  }
+  // solve bpm(from) * t + slope * t^2 / 2 = 60 * remaining qn
+  const auto bpm = bpmAtTime(from);
+  const auto slope = (bpmAtTime(from + 1.0e-3) - bpm) / 1.0e-3;
+  const auto remaining = 60. * (qn - fromQN);
+  if (std::fabs(slope) < 1.0e-9)
+    return from + remaining / bpm;
+  return from + (std::sqrt(bpm * bpm + 2. * slope * remaining) - bpm) / slope;
+}
+
+double ReaperSim::projectLength() const
+{
+  double length = 0.;
+  for (const auto& item : items)
+    length = std::max(length, item->end);
+  for (const auto& marker : markers)
+    length = std::max(length, marker.end);
+  return length;
+}
+
+void ReaperSim::play()
+{
+  if (playing || startPending)
+    return;
+  startPending = true;
+  startAt = now + startLatency;
+  startPos = cursor;
+  if (startLatency <= 0.)
+  {
+    startPending = false;
+    playing = true;
+    position = startPos;
+  }
+}
+
+void ReaperSim::stop()
+{
+  playing = startPending = false;
+  pendingRegion = -1;
+  position = cursor;
+}
+
+void ReaperSim::advance(double seconds)
+{
+  const auto end = now + seconds;
+  if (startPending && startAt <= end)
+  {
+    startPending = false;
+    playing = true;
+    position = startPos;
+    seconds = end - startAt;
+  }
+  now = end;
+  if (!playing)
+    return;
+
+  auto next = position + seconds * playrate;
+
+  // smooth seek requested by GoToRegion, at end of current region
+  if (pendingRegion >= 0)
+  {
+    const auto current = regionAt(position);
+    const auto target =
+      std::find_if(markers.begin(), markers.end(), [&](const auto& marker) {
+        return marker.isRegion && marker.id == pendingRegion;
+      });
+    if (target == markers.end())
+    {
+      pendingRegion = -1;
+    }
+    else if (current < 0 || next >= markers[current].end)
+    {
+      const auto overshoot =
+        current < 0 ? 0. : next - markers[current].end;
+      next = target->pos + overshoot;
+      pendingRegion = -1;
+      ++seeks;
+    }
+  }
+
+  if (repeat && loopEnd > loopStart && position < loopEnd && next >= loopEnd)
+  {
+    next = loopStart + std::fmod(next - loopEnd, loopEnd - loopStart);
+  }
+
+  position = next;
+}
+} // namespace reablink::sim
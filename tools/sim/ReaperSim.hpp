@@ -0,0 +1,108 @@
+#ifndef REABLINK_REAPERSIM_HPP
+#define REABLINK_REAPERSIM_HPP
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace reablink::sim
+{
+// Headless stand-in for the REAPER API functions used by AudioEngine.
+// Models one project with a tempo map, markers/regions, media items, loop
+// range and a transport running on a virtual clock. install() points the
+// reaper_plugin_functions.h function pointers at it.
+//
+// Simplifications: linear tempo ramps are linear in time and the measure
+// grid uses the time signature of the first tempo marker.
+class ReaperSim
+{
+public:
+  struct TempoMarker
+  {
+    double pos;
+    double bpm;
+    int num;
+    int denom;
+    bool linear;
+  };
+
+  struct ProjectMarker
+  {
+    bool isRegion;
+    double pos;
+    double end;
+    std::string name;
+    int id;
+  };
+
+  struct MidiEvent
+  {
+    int offset;
+    int size;
+    unsigned char message[4];
+  };
+
+  struct Item
+  {
+    int track;
+    double pos;
+    double end;
+  };
+
+  static ReaperSim& get();
+  void install();
+
+  // move virtual clock and transport forward
+  void advance(double seconds);
+  void reset(double bpm, int num = 4, int denom = 4);
+
+  double bpmAtTime(double time) const;
+  double qnAtTime(double time) const;
+  double timeAtQN(double qn) const;
+  int tempoMarkerAt(double time) const;
+  int regionAt(double time) const;
+  double projectLength() const;
+  void play();
+  void stop();
+
+  // configuration
+  double outputLatency{0.010}; // seconds
+  double startLatency{0.};     // seconds from OnPlayButton to playback
+  double playrateStep{1.0057929410678534}; // 10 cents, actions 40524/40525
+
+  // project
+  std::vector<TempoMarker> tempoMap{{0., 120., 4, 4, false}};
+  std::vector<ProjectMarker> markers;
+  std::vector<std::unique_ptr<Item>> items;
+  bool repeat{false};
+  double loopStart{0.};
+  double loopEnd{0.};
+
+  // host
+  std::string device{"ReaperSim"}; // GetAudioDeviceInfo IDENT_OUT
+  std::map<std::string, std::string> extState; // "section/key"
+  std::vector<MidiEvent> midiOut; // sent to any GetMidiOutput device
+
+  // transport
+  double now{0.};      // virtual clock, seconds
+  double cursor{0.};   // edit cursor
+  double position{0.}; // position of next audio block
+  double playrate{1.};
+  bool playing{false};
+  bool startPending{false};
+  double startAt{0.};
+  double startPos{0.}; // edit cursor when play was pressed
+  int pendingRegion{-1};
+
+  // statistics
+  int playrateCommands{0};
+  int seeks{0};
+  int changeCount{0};
+
+private:
+  ReaperSim() = default;
+};
+} // namespace reablink::sim
+
+#endif // REABLINK_REAPERSIM_HPP
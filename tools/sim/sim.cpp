@@ -0,0 +1,488 @@
+// Deterministic simulation of the Puppet sync loop against a headless REAPER
+// stand-in. A second in-process Link peer provides the session timeline;
+// REAPER time runs on a virtual clock anchored to the Link clock when the
+// run starts. Prints a JSON report of launch, convergence and steady-state
+// phase error. With --master REAPER leads and the peer follows, tempo
+// map changes are broadcast to the session. With --midi-clock the report
+// includes the error of every MIDI clock tick against the Link grid.
+// --drift-ppm runs the audio clock fast against the Link clock, and
+// --jitter-ms delays audio callbacks randomly, to check the clock drift
+// estimate and its compensation. --dropout stalls the audio clock once, the
+// audio hook's filter restarts as on a device dropout. With --max-error-ms the exit status is 2
+// when the run did not converge within --threshold-ms or its steady-state
+// error exceeded the maximum; ctest runs the default modes, start latency,
+// a peer tempo offset, the servo and clock drift that way.
+//
+// usage: reablink_sim [--seconds 60] [--tempo 120] [--peer-tempo 120]
+//                     [--srate 48000] [--block 512] [--latency 0.01]
+//                     [--start-latency 0] [--tick-ms 12] [--realtime]
+//                     [--threshold-ms 1] [--max-error-ms X]
+//                     [--peer-timeout 5] [--trace FILE] [--servo]
+//                     [--servo-bandwidth 0.5] [--servo-max-deviation 0.02]
+//                     [--calibrate RUNS] [--adaptive-ticks]
+//                     [--loop START END] [--tempo-change TIME BPM]
+//                     [--tempo-ramp START END BPM] [--master]
+//                     [--tempo-lookahead SECONDS] [--midi-clock]
+//                     [--drift-ppm 0] [--jitter-ms 0]
+//                     [--no-drift-compensation] [--dropout TIME MS]
+#include "Histogram.hpp"
+#include "HostTimeFilter.hpp"
+#include "ReaperSim.hpp"
+#include "engine.hpp"
+#include "global_vars.hpp"
+
+#include <ableton/Link.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace reablink;
+using reablink::sim::ReaperSim;
+
+namespace
+{
+struct Options
+{
+  double seconds{60.};
+  double tempo{120.};
+  double peerTempo{120.};
+  double srate{48000.};
+  int block{512};
+  double latency{0.010};
+  double startLatency{0.};
+  double tickMs{12.};
+  bool realtime{false};
+  double thresholdMs{1.};
+  double maxErrorMs{-1.};
+  double peerTimeout{5.};
+  bool servo{false};
+  double servoBandwidth{0.};
+  double servoMaxDeviation{0.};
+  int calibrate{0};
+  bool adaptiveTicks{false};
+  double loopStart{0.};
+  double loopEnd{0.}; // repeat on when after loopStart
+  double tempoChangeTime{-1.};
+  double tempoChangeBpm{0.};
+  double rampStart{-1.};
+  double rampEnd{-1.};
+  double rampBpm{0.};
+  bool master{false};
+  double tempoLookahead{-1.}; // engine default
+  bool midiClock{false};
+  double driftPpm{0.};
+  double jitterMs{0.};
+  bool driftCompensation{true};
+  double dropoutTime{-1.};
+  double dropoutMs{0.};
+  std::string trace;
+};
+
+Options parse(int argc, char** argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const auto value = [&]() {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "missing value for %s\n", arg.c_str());
+        exit(1);
+      }
+      return atof(argv[++i]);
+    };
+    if (arg == "--seconds")
+      opt.seconds = value();
+    else if (arg == "--tempo")
+      opt.tempo = value();
+    else if (arg == "--peer-tempo")
+      opt.peerTempo = value();
+    else if (arg == "--srate")
+      opt.srate = value();
+    else if (arg == "--block")
+      opt.block = (int)value();
+    else if (arg == "--latency")
+      opt.latency = value();
+    else if (arg == "--start-latency")
+      opt.startLatency = value();
+    else if (arg == "--tick-ms")
+      opt.tickMs = value();
+    else if (arg == "--realtime")
+      opt.realtime = true;
+    else if (arg == "--threshold-ms")
+      opt.thresholdMs = value();
+    else if (arg == "--max-error-ms")
+      opt.maxErrorMs = value();
+    else if (arg == "--peer-timeout")
+      opt.peerTimeout = value();
+    else if (arg == "--servo")
+      opt.servo = true;
+    else if (arg == "--servo-bandwidth")
+      opt.servoBandwidth = value();
+    else if (arg == "--servo-max-deviation")
+      opt.servoMaxDeviation = value();
+    else if (arg == "--tempo-change")
+    {
+      opt.tempoChangeTime = value();
+      opt.tempoChangeBpm = value();
+    }
+    else if (arg == "--tempo-ramp")
+    {
+      opt.rampStart = value();
+      opt.rampEnd = value();
+      opt.rampBpm = value();
+    }
+    else if (arg == "--master")
+      opt.master = true;
+    else if (arg == "--tempo-lookahead")
+      opt.tempoLookahead = value();
+    else if (arg == "--midi-clock")
+      opt.midiClock = true;
+    else if (arg == "--drift-ppm")
+      opt.driftPpm = value();
+    else if (arg == "--jitter-ms")
+      opt.jitterMs = value();
+    else if (arg == "--no-drift-compensation")
+      opt.driftCompensation = false;
+    else if (arg == "--dropout")
+    {
+      opt.dropoutTime = value();
+      opt.dropoutMs = value();
+    }
+    else if (arg == "--loop")
+    {
+      opt.loopStart = value();
+      opt.loopEnd = value();
+    }
+    else if (arg == "--adaptive-ticks")
+      opt.adaptiveTicks = true;
+    else if (arg == "--calibrate")
+      opt.calibrate = (int)value();
+    else if (arg == "--trace" && i + 1 < argc)
+      opt.trace = argv[++i];
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      exit(1);
+    }
+  }
+  return opt;
+}
+
+template <typename Predicate> bool waitFor(double seconds, Predicate done)
+{
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(seconds);
+  while (!done())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+// signed distance to nearest beat, in beats
+double wrapPhase(double beats)
+{
+  return beats - std::round(beats);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const auto opt = parse(argc, argv);
+
+  auto& sim = ReaperSim::get();
+  sim.install();
+  sim.reset(opt.tempo);
+  sim.outputLatency = opt.latency;
+  sim.startLatency = opt.startLatency;
+
+  ableton::Link link(opt.tempo);
+  ableton::Link peer(opt.peerTempo);
+  // session tempo changes as seen by the peer
+  std::atomic_int tempoChanges{0};
+  peer.setTempoCallback([&tempoChanges](double) { ++tempoChanges; });
+  link.enableStartStopSync(true);
+  peer.enableStartStopSync(true);
+  link.enable(true);
+  peer.enable(true);
+  const auto peers =
+    waitFor(opt.peerTimeout, [&] { return link.numPeers() > 0; })
+      ? link.numPeers()
+      : 0;
+  if (peers == 0)
+  {
+    fprintf(stderr, "no Link peers discovered, puppet correction disabled\n");
+  }
+
+  AudioPlatform platform(link);
+  auto& engine = platform.mEngine;
+  engine.setPuppet(true);
+  engine.setMaster(opt.master);
+  engine.setTempoLookahead(opt.tempoLookahead, -1.);
+  engine.setRealtime(opt.realtime);
+  engine.setMidiClock(opt.midiClock, 0);
+  engine.setClockDriftCompensation(opt.driftCompensation);
+  engine.setPlayrateServo(opt.servo, opt.servoBandwidth,
+                          opt.servoMaxDeviation);
+  if (!opt.trace.empty() && !engine.setTraceFile(opt.trace.c_str()))
+  {
+    fprintf(stderr, "cannot write trace %s\n", opt.trace.c_str());
+    return 1;
+  }
+
+  // session start comes from the peer
+  {
+    auto state = peer.captureAppSessionState();
+    state.setIsPlayingAndRequestBeatAtTime(true, peer.clock().micros(), 0., 4.);
+    peer.commitAppSessionState(state);
+  }
+  waitFor(1., [&] { return link.captureAppSessionState().isPlaying(); });
+  // launch follows once the calibration runs are done
+  if (opt.calibrate > 0)
+    engine.startCalibration(opt.calibrate);
+
+  const auto t0 = link.clock().micros();
+  // audio clock seconds to Link clock
+  const auto toHostTime = [&](double seconds) {
+    if (opt.dropoutTime >= 0. && seconds >= opt.dropoutTime)
+      seconds += opt.dropoutMs / 1000.;
+    return t0 + std::chrono::microseconds(
+                  llround(seconds / (1. + opt.driftPpm * 1.0e-6) * 1.0e6));
+  };
+  // audio callback timing as the audio hook sees it
+  HostTimeFilter<> filter;
+  filter.reset(1.0e6 / opt.srate);
+  std::mt19937 random(1);
+  std::uniform_real_distribution<double> jitter(0., opt.jitterMs * 1000.);
+  auto sampleTime = 0.;
+
+  const auto blockTime = opt.block / opt.srate;
+  const auto tickTime = opt.tickMs / 1000.;
+  const auto threshold = opt.thresholdMs / 1000.;
+  if (opt.tempoChangeTime > 0.)
+  {
+    sim.tempoMap.push_back(
+      {opt.tempoChangeTime, opt.tempoChangeBpm, 4, 4, false});
+  }
+  if (opt.rampEnd > opt.rampStart && opt.rampStart > 0.)
+  {
+    const auto from = sim.bpmAtTime(opt.rampStart);
+    sim.tempoMap.push_back({opt.rampStart, from, 4, 4, true});
+    sim.tempoMap.push_back({opt.rampEnd, opt.rampBpm, 4, 4, false});
+  }
+  std::stable_sort(sim.tempoMap.begin(), sim.tempoMap.end(),
+                   [](const auto& a, const auto& b) { return a.pos < b.pos; });
+  const auto tempoChangesAtStart = tempoChanges.load();
+  sim.repeat = opt.loopEnd > opt.loopStart;
+  sim.loopStart = opt.loopStart;
+  sim.loopEnd = opt.loopEnd;
+  std::vector<double> wraps;
+  // REAPER quarter notes skipped by loop wraps, the engine keeps phase
+  // continuous across them
+  auto loopShift = 0.;
+
+  auto nextTick = 0.;
+  auto ticks = 0;
+  auto launchTime = -1.;
+  auto lastOutside = -1.;
+  std::vector<std::pair<double, double>> errors;
+  // MIDI clock tick error against the Link grid, nanoseconds
+  LogHistogram<> midiErrors;
+  auto midiTicks = 0;
+  auto midiStarts = 0;
+  auto midiContinues = 0;
+  auto midiStops = 0;
+
+  for (double now = 0.; now < opt.seconds; now += blockTime)
+  {
+    // pre-buffer audio hook
+    sim.now = now;
+    g_abuf_len = opt.block;
+    g_abuf_srate = opt.srate;
+    const auto callbackTime = (double)toHostTime(now).count() + jitter(random);
+    // restarts as the audio hook's does
+    const auto reset =
+      sampleTime == 0. ||
+      std::abs(callbackTime - filter.hostTimeAt(sampleTime)) >
+        (2. * blockTime + 0.01) * 1.0e6;
+    if (reset)
+      filter.reset(1.0e6 / opt.srate);
+    const auto filtered = filter.update(sampleTime, callbackTime);
+    engine.updateClockDrift(reset, sampleTime, filtered, opt.srate);
+    sampleTime += opt.block;
+    g_abuf_time = filtered / 1.0e6;
+    g_abuf_sample_period = filter.slope() / 1.0e6;
+    // heard at, and as the engine estimates it
+    const auto trueHostTime = toHostTime(now + opt.latency + blockTime);
+    const auto hostTime = std::chrono::microseconds(llround(
+      (g_abuf_time + opt.latency + opt.block * g_abuf_sample_period) * 1.0e6));
+    engine.audioBlockCallback(hostTime, opt.block);
+    engine.midiClockCallback(hostTime, opt.block);
+    if (!sim.midiOut.empty())
+    {
+      const auto state = link.captureAppSessionState();
+      for (const auto& event : sim.midiOut)
+      {
+        switch (event.message[0])
+        {
+        case 0xF8:
+        {
+          // exact time of the tick, between microseconds
+          const auto time =
+            (double)trueHostTime.count() +
+            event.offset * 1.0e6 / opt.srate / (1. + opt.driftPpm * 1.0e-6);
+          const auto micros =
+            std::chrono::microseconds((long long)std::floor(time));
+          const auto tick =
+            state.beatAtTime(micros, 1.) * 24. +
+            (time - (double)micros.count()) * state.tempo() / 60.0e6 * 24.;
+          midiErrors.add(std::fabs(tick - std::round(tick)) / 24. * 60. /
+                         state.tempo() * 1.0e9);
+          ++midiTicks;
+          break;
+        }
+        case 0xFA:
+          ++midiStarts;
+          break;
+        case 0xFB:
+          ++midiContinues;
+          break;
+        case 0xFC:
+          ++midiStops;
+          break;
+        }
+      }
+      sim.midiOut.clear();
+    }
+
+    // phase of the block about to be rendered, against Link at the time
+    // it is heard
+    if (sim.playing && engine.getCalibration(nullptr) == 0)
+    {
+      if (launchTime < 0.)
+        launchTime = now;
+      const auto state = link.captureAppSessionState();
+      const auto linkBeat = state.beatAtTime(trueHostTime, 1.);
+      const auto error =
+        wrapPhase(sim.qnAtTime(sim.position) + loopShift - linkBeat) * 60. /
+        state.tempo();
+      errors.emplace_back(now, error);
+      if (std::fabs(error) > threshold)
+        lastOutside = now;
+    }
+
+    const auto position = sim.position;
+    sim.advance(blockTime);
+    if (sim.playing && sim.position < position)
+    {
+      wraps.push_back(now + blockTime);
+      loopShift += sim.qnAtTime(sim.loopEnd) - sim.qnAtTime(sim.loopStart);
+    }
+
+    // main thread timer ticks during this block, REAPER position is that
+    // of the next block now
+    while (nextTick < now + blockTime)
+    {
+      sim.now = nextTick;
+      engine.audioCallback(
+        std::chrono::microseconds(
+          llround((g_abuf_time + opt.latency + 2. * blockTime) * 1.0e6)),
+        opt.block);
+      nextTick += opt.adaptiveTicks ? engine.tickInterval() / 1000. : tickTime;
+      ++ticks;
+    }
+    sim.now = now + blockTime;
+  }
+
+  // steady state is the second half of the run
+  double sumSquares = 0.;
+  double maxError = 0.;
+  size_t steadyCount = 0;
+  for (const auto& [time, error] : errors)
+  {
+    if (time < opt.seconds / 2.)
+      continue;
+    sumSquares += error * error;
+    maxError = std::max(maxError, std::fabs(error));
+    ++steadyCount;
+  }
+  const auto rms = steadyCount ? std::sqrt(sumSquares / steadyCount) : 0.;
+
+  // worst error within half a second after loop wraps of the second half
+  double wrapMaxError = 0.;
+  for (const auto wrap : wraps)
+  {
+    if (wrap < opt.seconds / 2.)
+      continue;
+    for (const auto& [time, error] : errors)
+    {
+      if (time >= wrap && time < wrap + 0.5)
+        wrapMaxError = std::max(wrapMaxError, std::fabs(error));
+    }
+  }
+  const auto converged = launchTime >= 0. && lastOutside < opt.seconds / 2.;
+  const auto convergence =
+    launchTime < 0. ? -1.
+                    : std::max(0., lastOutside + blockTime - launchTime);
+
+  printf("{\n");
+  printf("  \"mode\": \"%s\",\n", opt.realtime ? "realtime" : "timer");
+  printf("  \"correction\": \"%s\",\n", opt.servo ? "servo" : "steps");
+  printf("  \"role\": \"%s\",\n", opt.master ? "master" : "puppet");
+  printf("  \"peers\": %zu,\n", peers);
+  printf("  \"seconds\": %g,\n", opt.seconds);
+  printf("  \"block\": %d,\n", opt.block);
+  printf("  \"srate\": %g,\n", opt.srate);
+  printf("  \"launch_s\": %.6f,\n", launchTime);
+  printf("  \"launch_error_ms\": %.6f,\n",
+         errors.empty() ? 0. : errors.front().second * 1000.);
+  printf("  \"converged\": %s,\n", converged ? "true" : "false");
+  printf("  \"convergence_s\": %.6f,\n", convergence);
+  printf("  \"steady_rms_ms\": %.6f,\n", rms * 1000.);
+  printf("  \"steady_max_ms\": %.6f,\n", maxError * 1000.);
+  printf("  \"playrate_commands\": %d,\n", sim.playrateCommands);
+  printf("  \"ticks\": %d,\n", ticks);
+  printf("  \"loop_wraps\": %zu,\n", wraps.size());
+  printf("  \"wrap_max_ms\": %.6f,\n", wrapMaxError * 1000.);
+  printf("  \"tempo_changes\": %d,\n", tempoChanges - tempoChangesAtStart);
+  if (opt.midiClock)
+  {
+    printf("  \"midi_ticks\": %d,\n", midiTicks);
+    printf("  \"midi_starts\": %d,\n", midiStarts);
+    printf("  \"midi_continues\": %d,\n", midiContinues);
+    printf("  \"midi_stops\": %d,\n", midiStops);
+    printf("  \"midi_p50_us\": %.3f,\n", midiErrors.percentile(50.) / 1000.);
+    printf("  \"midi_p99_us\": %.3f,\n", midiErrors.percentile(99.) / 1000.);
+    printf("  \"midi_max_us\": %.3f,\n", midiErrors.max() / 1000.);
+  }
+  {
+    bool compensated{false};
+    const auto drift = engine.getClockDrift(&compensated);
+    printf("  \"drift_ppm\": %g,\n", opt.driftPpm);
+    printf("  \"drift_estimate_ppm\": %.3f,\n", drift);
+    printf("  \"drift_compensated\": %s,\n", compensated ? "true" : "false");
+  }
+  printf("  \"final_playrate\": %.6f\n", sim.playrate);
+  printf("}\n");
+
+  engine.setTraceFile(nullptr);
+  link.enable(false);
+  peer.enable(false);
+
+  if (opt.maxErrorMs >= 0. &&
+      (!converged || maxError * 1000. > opt.maxErrorMs))
+    return 2;
+  return 0;
+}
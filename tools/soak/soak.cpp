@@ -0,0 +1,508 @@
+// Multi-peer Link session soak benchmark. For every combination of peer
+// count and timer interval, runs the Puppet engine against N in-process
+// Link peers on loopback while the peers randomly change tempo, stop and
+// restart the session and the project time signature (quantum) changes.
+// The engine sits behind a host Link set up like the LinkSession singleton
+// in src/api.cpp; REAPER is the headless stand-in from tools/sim, paced to
+// wall clock so Link discovery and session traffic run at real speed.
+//
+// Prints JSON with per-peer phase divergence, tempo convergence latency,
+// launch convergence latency and CPU time per tick as histograms, and the
+// first configuration where the puppet loop stopped converging.
+//
+// usage: reablink_soak [--peers 1,2,4,6,8,10] [--tick-ms 12] [--seconds 60]
+//                      [--settle 4] [--event-rate 0.2] [--seed 1]
+//                      [--threshold-ms 2] [--min-converged 0.9]
+//                      [--srate 48000] [--block 512] [--latency 0.01]
+//                      [--realtime] [--peer-timeout 5]
+#include "Histogram.hpp"
+#include "ReaperSim.hpp"
+#include "engine.hpp"
+#include "global_vars.hpp"
+
+#include <ableton/Link.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <reaper_plugin_functions.h>
+
+using namespace reablink;
+using reablink::sim::ReaperSim;
+
+namespace
+{
+using Histogram = LogHistogram<>;
+
+struct Options
+{
+  std::vector<int> peers{1, 2, 4, 6, 8, 10};
+  std::vector<double> tickMs{12.};
+  double seconds{60.};
+  double settle{4.};
+  double eventRate{0.2};
+  unsigned seed{1};
+  double thresholdMs{2.};
+  double minConverged{0.9};
+  double srate{48000.};
+  int block{512};
+  double latency{0.010};
+  bool realtime{false};
+  double peerTimeout{5.};
+};
+
+template <typename T> std::vector<T> parseList(const char* text)
+{
+  std::vector<T> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ','))
+  {
+    values.push_back((T)atof(item.c_str()));
+  }
+  return values;
+}
+
+Options parse(int argc, char** argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const auto text = [&]() {
+      if (i + 1 >= argc)
+      {
+        fprintf(stderr, "missing value for %s\n", arg.c_str());
+        exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--peers")
+      opt.peers = parseList<int>(text());
+    else if (arg == "--tick-ms")
+      opt.tickMs = parseList<double>(text());
+    else if (arg == "--seconds")
+      opt.seconds = atof(text());
+    else if (arg == "--settle")
+      opt.settle = atof(text());
+    else if (arg == "--event-rate")
+      opt.eventRate = atof(text());
+    else if (arg == "--seed")
+      opt.seed = (unsigned)atoi(text());
+    else if (arg == "--threshold-ms")
+      opt.thresholdMs = atof(text());
+    else if (arg == "--min-converged")
+      opt.minConverged = atof(text());
+    else if (arg == "--srate")
+      opt.srate = atof(text());
+    else if (arg == "--block")
+      opt.block = atoi(text());
+    else if (arg == "--latency")
+      opt.latency = atof(text());
+    else if (arg == "--realtime")
+      opt.realtime = true;
+    else if (arg == "--peer-timeout")
+      opt.peerTimeout = atof(text());
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      exit(1);
+    }
+  }
+  return opt;
+}
+
+template <typename Predicate> bool waitFor(double seconds, Predicate done)
+{
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::duration<double>(seconds);
+  while (!done())
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+// signed distance to nearest beat, in beats
+double wrapPhase(double beats)
+{
+  return beats - std::round(beats);
+}
+
+double elapsedMicros(std::chrono::steady_clock::time_point since)
+{
+  return std::chrono::duration<double, std::micro>(
+           std::chrono::steady_clock::now() - since)
+    .count();
+}
+
+struct Result
+{
+  int peers{0};
+  size_t discovered{0};
+  double tickMs{0.};
+  uint64_t samples{0};
+  uint64_t samplesInside{0};
+  std::vector<Histogram> phase;
+  Histogram phaseAll;
+  Histogram tempoLatency;
+  Histogram launchLatency;
+  Histogram tickCpu;
+  Histogram blockCpu;
+  int tempoEvents{0};
+  int tempoTimeouts{0};
+  int startStopEvents{0};
+  int launchTimeouts{0};
+  int quantumEvents{0};
+  int playrateCommands{0};
+
+  double convergedFraction() const
+  {
+    return samples ? (double)samplesInside / samples : 0.;
+  }
+};
+
+// host side, set up like LinkSession in src/api.cpp
+struct Host
+{
+  ableton::Link link;
+  AudioPlatform platform;
+
+  explicit Host(double bpm) : link(bpm), platform(link)
+  {
+    link.setTempoCallback([this](double tempo) {
+      if (platform.mEngine.getPuppet())
+      {
+        platform.mEngine.setTempo(tempo);
+      }
+    });
+  }
+};
+
+Result run(const Options& opt, int numPeers, double tickMs, std::mt19937& rng)
+{
+  constexpr double tempoTimeout = 10.;
+  constexpr double launchTimeout = 15.;
+  constexpr double launchSteady = 1.;
+
+  auto& sim = ReaperSim::get();
+  sim.reset(120.);
+  sim.outputLatency = opt.latency;
+
+  Result result;
+  result.peers = numPeers;
+  result.tickMs = tickMs;
+  result.phase.resize(numPeers);
+
+  auto host = std::make_unique<Host>(Master_GetTempo());
+  auto& link = host->link;
+  auto& engine = host->platform.mEngine;
+  link.enableStartStopSync(true);
+  link.enable(true);
+
+  std::vector<std::unique_ptr<ableton::Link>> peers;
+  for (int i = 0; i < numPeers; ++i)
+  {
+    peers.push_back(std::make_unique<ableton::Link>(120.));
+    peers.back()->enableStartStopSync(true);
+    peers.back()->enable(true);
+  }
+  waitFor(opt.peerTimeout,
+          [&] { return link.numPeers() >= (size_t)numPeers; });
+  result.discovered = link.numPeers();
+
+  engine.setPuppet(true);
+  engine.setRealtime(opt.realtime);
+
+  std::uniform_real_distribution<double> unit(0., 1.);
+  std::uniform_int_distribution<int> pickPeer(0, numPeers - 1);
+  std::uniform_int_distribution<int> pickEvent(0, 2);
+  std::uniform_int_distribution<int> pickNum(3, 7);
+  double quantum = 4.;
+
+  const auto startSession = [&](ableton::Link& peer) {
+    auto state = peer.captureAppSessionState();
+    state.setIsPlayingAndRequestBeatAtTime(
+      true, peer.clock().micros(), 0., quantum);
+    peer.commitAppSessionState(state);
+  };
+  startSession(*peers.front());
+
+  const auto blockTime = opt.block / opt.srate;
+  const auto tickTime = tickMs / 1000.;
+  const auto threshold = opt.thresholdMs / 1000.;
+  const auto eventProbability = opt.eventRate * blockTime;
+  const auto wallStart = std::chrono::steady_clock::now();
+  const auto t0 = link.clock().micros();
+  const auto toHostTime = [&](double seconds) {
+    return t0 + std::chrono::microseconds(llround(seconds * 1.0e6));
+  };
+
+  auto nextTick = 0.;
+  auto lastDisruption = 0.;
+  auto restartAt = -1.;
+  auto tempoTarget = 0.;
+  auto tempoSince = -1.;
+  auto launchSince = 0.;
+  auto lastOutside = 0.;
+
+  for (double now = 0.; now < opt.seconds; now += blockTime)
+  {
+    using Clock = std::chrono::steady_clock;
+    std::this_thread::sleep_until(
+      wallStart + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(now)));
+
+    // pre-buffer audio hook
+    sim.now = now;
+    g_abuf_len = opt.block;
+    g_abuf_srate = opt.srate;
+    g_abuf_time = (double)toHostTime(now).count() / 1.0e6;
+    const auto hostTime = toHostTime(now + opt.latency + blockTime);
+    if (opt.realtime)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      engine.audioBlockCallback(hostTime, opt.block);
+      result.blockCpu.add(elapsedMicros(start));
+    }
+
+    // phase divergence of every peer against what REAPER plays
+    const auto sessionPlaying = link.captureAppSessionState().isPlaying();
+    auto allInside = sim.playing && sessionPlaying;
+    for (int i = 0; i < numPeers && sim.playing && sessionPlaying; ++i)
+    {
+      const auto state = peers[i]->captureAppSessionState();
+      const auto error =
+        std::fabs(wrapPhase(sim.qnAtTime(sim.position) -
+                            state.beatAtTime(hostTime, 1.)) *
+                  60. / state.tempo());
+      allInside = allInside && error <= threshold;
+      if (now - lastDisruption >= opt.settle)
+      {
+        result.phase[i].add(error * 1.0e6);
+        result.phaseAll.add(error * 1.0e6);
+        ++result.samples;
+        if (error <= threshold)
+          ++result.samplesInside;
+      }
+    }
+    if (!allInside)
+      lastOutside = now;
+
+    // launch convergence
+    if (launchSince >= 0.)
+    {
+      if (now - lastOutside >= launchSteady)
+      {
+        result.launchLatency.add((lastOutside - launchSince) * 1.0e6);
+        launchSince = -1.;
+      }
+      else if (now - launchSince > launchTimeout)
+      {
+        ++result.launchTimeouts;
+        launchSince = -1.;
+      }
+    }
+
+    // tempo convergence, REAPER and host session agree with the peer
+    if (tempoSince >= 0.)
+    {
+      int num{0};
+      int denom{0};
+      double reaperTempo{0.};
+      TimeMap_GetTimeSigAtTime(0, GetPlayPosition2(), &num, &denom,
+                               &reaperTempo);
+      const auto linkTempo = link.captureAppSessionState().tempo();
+      if (std::fabs(reaperTempo - tempoTarget) < 0.01 &&
+          std::fabs(linkTempo - tempoTarget) < 0.01)
+      {
+        result.tempoLatency.add((now - tempoSince) * 1.0e6);
+        tempoSince = -1.;
+      }
+      else if (now - tempoSince > tempoTimeout)
+      {
+        ++result.tempoTimeouts;
+        tempoSince = -1.;
+      }
+    }
+
+    sim.advance(blockTime);
+
+    // main thread timer ticks during this block, REAPER position is that
+    // of the next block now
+    while (nextTick < now + blockTime)
+    {
+      sim.now = nextTick;
+      const auto start = std::chrono::steady_clock::now();
+      engine.audioCallback(
+        std::chrono::microseconds(
+          llround((g_abuf_time + opt.latency + 2. * blockTime) * 1.0e6)),
+        opt.block);
+      result.tickCpu.add(elapsedMicros(start));
+      nextTick += tickTime;
+    }
+    sim.now = now + blockTime;
+
+    // random peer events
+    if (restartAt >= 0. && now >= restartAt)
+    {
+      startSession(*peers[pickPeer(rng)]);
+      restartAt = -1.;
+      lastDisruption = launchSince = lastOutside = now;
+    }
+    if (unit(rng) >= eventProbability || restartAt >= 0.)
+      continue;
+
+    auto& peer = *peers[pickPeer(rng)];
+    switch (pickEvent(rng))
+    {
+    case 0: // tempo
+    {
+      if (tempoSince >= 0.)
+        ++result.tempoTimeouts; // superseded before converging
+      tempoTarget = std::round((80. + unit(rng) * 80.) * 10.) / 10.;
+      auto state = peer.captureAppSessionState();
+      state.setTempo(tempoTarget, peer.clock().micros());
+      peer.commitAppSessionState(state);
+      tempoSince = lastDisruption = now;
+      ++result.tempoEvents;
+      break;
+    }
+    case 1: // stop, restarted by some peer shortly after
+    {
+      auto state = peer.captureAppSessionState();
+      state.setIsPlaying(false, peer.clock().micros());
+      peer.commitAppSessionState(state);
+      restartAt = now + 0.5 + unit(rng) * 1.5;
+      launchSince = -1.;
+      lastDisruption = now;
+      ++result.startStopEvents;
+      break;
+    }
+    default: // quantum, as a project time signature change
+    {
+      const auto num = pickNum(rng);
+      for (auto& marker : sim.tempoMap)
+        marker.num = num;
+      ++sim.changeCount;
+      quantum = num;
+      lastDisruption = now;
+      ++result.quantumEvents;
+      break;
+    }
+    }
+  }
+
+  result.playrateCommands = sim.playrateCommands;
+  for (auto& peer : peers)
+    peer->enable(false);
+  link.enable(false);
+  return result;
+}
+
+void printHistogram(const Histogram& histogram)
+{
+  printf("{\"count\": %llu, \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, "
+         "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+         (unsigned long long)histogram.count(), histogram.min(),
+         histogram.mean(), histogram.percentile(50.),
+         histogram.percentile(90.), histogram.percentile(99.),
+         histogram.max());
+}
+
+void printResult(const Result& result, const char* converged)
+{
+  printf("    {\n");
+  printf("      \"peers\": %d,\n", result.peers);
+  printf("      \"discovered\": %zu,\n", result.discovered);
+  printf("      \"tick_ms\": %g,\n", result.tickMs);
+  printf("      \"samples\": %llu,\n", (unsigned long long)result.samples);
+  printf("      \"converged_fraction\": %.4f,\n", result.convergedFraction());
+  printf("      \"converged\": %s,\n", converged);
+  printf("      \"events\": {\"tempo\": %d, \"start_stop\": %d, "
+         "\"quantum\": %d},\n",
+         result.tempoEvents, result.startStopEvents, result.quantumEvents);
+  printf("      \"tempo_timeouts\": %d,\n", result.tempoTimeouts);
+  printf("      \"launch_timeouts\": %d,\n", result.launchTimeouts);
+  printf("      \"playrate_commands\": %d,\n", result.playrateCommands);
+  printf("      \"phase_us\": ");
+  printHistogram(result.phaseAll);
+  printf(",\n      \"phase_per_peer_us\": [\n");
+  for (size_t i = 0; i < result.phase.size(); ++i)
+  {
+    printf("        ");
+    printHistogram(result.phase[i]);
+    printf("%s\n", i + 1 < result.phase.size() ? "," : "");
+  }
+  printf("      ],\n      \"tempo_latency_us\": ");
+  printHistogram(result.tempoLatency);
+  printf(",\n      \"launch_latency_us\": ");
+  printHistogram(result.launchLatency);
+  printf(",\n      \"tick_cpu_us\": ");
+  printHistogram(result.tickCpu);
+  printf(",\n      \"block_cpu_us\": ");
+  printHistogram(result.blockCpu);
+  printf("\n    }");
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const auto opt = parse(argc, argv);
+
+  auto& sim = ReaperSim::get();
+  sim.install();
+  std::mt19937 rng(opt.seed);
+
+  printf("{\n");
+  printf("  \"mode\": \"%s\",\n", opt.realtime ? "realtime" : "timer");
+  printf("  \"seconds\": %g,\n", opt.seconds);
+  printf("  \"seed\": %u,\n", opt.seed);
+  printf("  \"threshold_ms\": %g,\n", opt.thresholdMs);
+  printf("  \"configs\": [\n");
+
+  int failingPeers = -1;
+  double failingTickMs = 0.;
+  bool first = true;
+  for (const auto tickMs : opt.tickMs)
+  {
+    for (const auto numPeers : opt.peers)
+    {
+      if (numPeers < 1)
+        continue;
+      fprintf(stderr, "soak: %d peers, %g ms tick\n", numPeers, tickMs);
+      const auto result = run(opt, numPeers, tickMs, rng);
+      // no settled samples when events come faster than --settle
+      const auto measured = result.samples > 0;
+      const auto converged = result.convergedFraction() >= opt.minConverged;
+      if (measured && !converged && failingPeers < 0)
+      {
+        failingPeers = numPeers;
+        failingTickMs = tickMs;
+      }
+      printf("%s", first ? "" : ",\n");
+      printResult(result,
+                  !measured ? "null" : converged ? "true" : "false");
+      fflush(stdout);
+      first = false;
+    }
+  }
+
+  printf("\n  ],\n");
+  if (failingPeers < 0)
+    printf("  \"first_failing\": null\n");
+  else
+    printf("  \"first_failing\": {\"peers\": %d, \"tick_ms\": %g}\n",
+           failingPeers, failingTickMs);
+  printf("}\n");
+  return 0;
+}